@@ -0,0 +1,449 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "archive.h"
+#include "ds1922.h"
+#include "ds1922snapshot.h"
+#include "samplecodec.h"
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+static const char archiveMagic[4] = {'Q', 'I', 'B', 'M'};
+
+/**
+ * @brief Converts a raw value of this mission to °C, see ArchiveReader::GetRawValues()
+ */
+double MissionHeader::ConvertValue(int32_t raw) const
+{
+   double result;
+   ConvertValues(&raw, 1, &result);
+   return result;
+}
+
+/**
+ * @brief Converts @p count raw values of this mission to °C
+ * 
+ * The conversion kernel is selected once for the type and resolution of the mission.
+ */
+void MissionHeader::ConvertValues(const int32_t* raw, int count, double* buffer) const
+{
+   bool calibrated = flags & FLAG_CALIBRATION;
+   DS1922Decoder::GetRawConverter((DS1922::Type)type, bytesPerSample==2, calibrated)(raw, count, calibration, buffer);
+}
+
+ArchiveWriter::ArchiveWriter()
+{
+   m_fd = -1;
+   m_encoding = MissionHeader::ENCODING_DELTA;
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+   Close();
+}
+
+/**
+ * @brief Opens @p fileName for appending, creating it if needed
+ */
+bool ArchiveWriter::Open(const char* fileName)
+{
+   Close();
+   m_fd = open(fileName, O_WRONLY|O_APPEND|O_CREAT, 0644);
+   if (m_fd<0) {
+      m_lastError = std::string(fileName)+": "+strerror(errno);
+      return false;
+   }
+   return true;
+}
+
+void ArchiveWriter::Close()
+{
+   if (m_fd>=0) {
+      close(m_fd);
+      m_fd = -1;
+   }
+}
+
+/**
+ * @brief Fills @p header with the mission parameters of @p ds1922
+ * 
+ * ReadRegister() has to be called on @p ds1922 before. The stored sample range, encoding and dataSize are not set.
+ */
+void ArchiveWriter::FillHeader(DS1922& ds1922, MissionHeader& header)
+{
+   memset(&header, 0, sizeof(header));
+   header.rom = ds1922.GetRom();
+   header.type = ds1922.GetType();
+   header.bytesPerSample = ds1922.GetHighResLogging() ? 2 : 1;
+   if (ds1922.GetHighResLogging())
+      header.flags |= MissionHeader::FLAG_HIGHRES;
+   if (ds1922.GetRollover())
+      header.flags |= MissionHeader::FLAG_ROLLOVER;
+   if (ds1922.GetCalibration(header.calibration))
+      header.flags |= MissionHeader::FLAG_CALIBRATION;
+   header.interval = ds1922.GetSampleRate();
+   if (!ds1922.GetHighspeedSampling())
+      header.interval *= 60;
+   tm time;
+   memset(&time, 0, sizeof(time));
+   ds1922.GetMissionTimestamp(&time);
+   time.tm_isdst = -1;
+   header.missionStart = mktime(&time);
+   header.readoutTime = ::time(NULL);
+   header.missionSamples = ds1922.GetSampleCount();
+   ds1922.GetRegister(header.registerPages);
+}
+
+/**
+ * @brief Fills @p header with the mission parameters held by @p snapshot
+ * 
+ * The stored sample range, encoding and dataSize are not set.
+ */
+void ArchiveWriter::FillHeader(const DS1922Snapshot& snapshot, MissionHeader& header)
+{
+   memset(&header, 0, sizeof(header));
+   header.rom = snapshot.GetRom();
+   header.type = snapshot.GetType();
+   header.bytesPerSample = snapshot.GetHighResLogging() ? 2 : 1;
+   if (snapshot.GetHighResLogging())
+      header.flags |= MissionHeader::FLAG_HIGHRES;
+   if (snapshot.GetRollover())
+      header.flags |= MissionHeader::FLAG_ROLLOVER;
+   if (snapshot.GetCalibration()) {
+      memcpy(header.calibration, snapshot.GetCalibration(), sizeof(header.calibration));
+      header.flags |= MissionHeader::FLAG_CALIBRATION;
+   }
+   header.interval = snapshot.GetInterval();
+   header.missionStart = snapshot.GetMissionTimestamp();
+   header.readoutTime = ::time(NULL);
+   header.missionSamples = snapshot.GetSampleCount();
+   memcpy(header.registerPages, snapshot.GetRegister(), sizeof(header.registerPages));
+}
+
+/**
+ * @brief Downloads the mission of @p ds1922 and appends it
+ * 
+ * ReadRegister() has to be called on @p ds1922 before. All samples still available in the device from mission
+ * sample number @p first on are stored.
+ * @param MissionHeader* written: if not NULL, receives the header of the record
+ * @param uint64_t* offset: if not NULL, receives the file offset of the record
+ */
+bool ArchiveWriter::Append(DS1922& ds1922, int first, MissionHeader* written, uint64_t* offset)
+{
+   MissionHeader header;
+   FillHeader(ds1922, header);
+   int firstSample = header.missionSamples - ds1922.GetLogCapacity();
+   if (firstSample<first)
+      firstSample = first;
+   header.firstSample = firstSample>0 ? firstSample : 0;
+   header.sampleCount = header.missionSamples>header.firstSample ? header.missionSamples-header.firstSample : 0;
+   
+   std::vector<uint8_t> data(header.sampleCount*header.bytesPerSample);
+   if (!ds1922.ReadRawSamples(data.data(), header.firstSample, header.sampleCount)) {
+      m_lastError = ds1922.GetLastError();
+      return false;
+   }
+   return AppendEncoded(header, data, written, offset);
+}
+
+/**
+ * @brief Appends the mission held by @p snapshot, from mission sample number @p first on
+ * 
+ * Like Append(DS1922&, ...), but without reading from the device. The snapshot has to be taken with its log.
+ */
+bool ArchiveWriter::Append(const DS1922Snapshot& snapshot, int first, MissionHeader* written, uint64_t* offset)
+{
+   MissionHeader header;
+   FillHeader(snapshot, header);
+   int firstSample = std::max(first, snapshot.GetFirstSample());
+   int endSample = snapshot.GetFirstSample() + snapshot.GetLogSamples();
+   header.firstSample = firstSample;
+   header.sampleCount = endSample>firstSample ? endSample-firstSample : 0;
+   const uint8_t* log = snapshot.GetLog() + (firstSample-snapshot.GetFirstSample())*header.bytesPerSample;
+   std::vector<uint8_t> data(log, log + header.sampleCount*header.bytesPerSample);
+   return AppendEncoded(header, data, written, offset);
+}
+
+/**
+ * @brief Encodes the raw samples in @p data, which are replaced, and appends the record
+ */
+bool ArchiveWriter::AppendEncoded(MissionHeader& header, std::vector<uint8_t>& data, MissionHeader* written,
+                                  uint64_t* offset)
+{
+   if (m_encoding==MissionHeader::ENCODING_DELTA) {
+      std::vector<int32_t> values(header.sampleCount);
+      for (size_t i=0; i<values.size(); i++)
+         values[i] = header.bytesPerSample==2 ? data[i*2]<<8 | data[i*2+1] : data[i];
+      data.clear();
+      SampleCodec::Encode(values.data(), values.size(), data);
+   }
+   header.encoding = m_encoding;
+   header.dataSize = data.size();
+   if (written)
+      *written = header;
+   return Append(header, data.data(), offset);
+}
+
+/**
+ * @brief Appends a record
+ * 
+ * magic, version and headerSize of @p header are filled in.
+ */
+bool ArchiveWriter::Append(const MissionHeader& header, const uint8_t* data, uint64_t* offset)
+{
+   if (m_fd<0) {
+      m_lastError = "Archive not open";
+      return false;
+   }
+   MissionHeader record = header;
+   memcpy(record.magic, archiveMagic, sizeof(archiveMagic));
+   record.version = 1;
+   record.headerSize = sizeof(MissionHeader);
+   
+   // write the record with one call, so it is appended as a whole
+   std::vector<uint8_t> buffer(record.GetRecordSize(), 0);
+   memcpy(buffer.data(), &record, sizeof(record));
+   memcpy(buffer.data()+sizeof(record), data, record.dataSize);
+   ssize_t result = write(m_fd, buffer.data(), buffer.size());
+   if (result!=(ssize_t)buffer.size()) {
+      m_lastError = result<0 ? strerror(errno) : "Short write";
+      return false;
+   }
+   if (offset)
+      *offset = lseek(m_fd, 0, SEEK_CUR) - buffer.size();
+   return true;
+}
+
+
+ArchiveReader::ArchiveReader()
+{
+   m_map = NULL;
+   m_size = 0;
+}
+
+ArchiveReader::~ArchiveReader()
+{
+   Close();
+}
+
+/**
+ * @brief Maps @p fileName and indexes its records if @p index is true
+ * 
+ * A truncated record at the end of the file, e.g. from an interrupted write, is ignored.
+ */
+bool ArchiveReader::Open(const char* fileName, bool index)
+{
+   Close();
+   int fd = open(fileName, O_RDONLY);
+   if (fd<0) {
+      m_lastError = std::string(fileName)+": "+strerror(errno);
+      return false;
+   }
+   struct stat status;
+   if (fstat(fd, &status)!=0) {
+      m_lastError = strerror(errno);
+      close(fd);
+      return false;
+   }
+   m_size = status.st_size;
+   if (m_size>0) {
+      void* map = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (map==MAP_FAILED) {
+         m_lastError = strerror(errno);
+         close(fd);
+         m_size = 0;
+         return false;
+      }
+      m_map = (const uint8_t*)map;
+   }
+   close(fd);
+   
+   size_t offset = 0;
+   while (index && offset+sizeof(MissionHeader)<=m_size) {
+      const MissionHeader* header = (const MissionHeader*)(m_map+offset);
+      if (memcmp(header->magic, archiveMagic, sizeof(archiveMagic))!=0 || header->headerSize<sizeof(MissionHeader)) {
+         m_lastError = "Invalid archive record";
+         Close();
+         return false;
+      }
+      if (offset+header->GetRecordSize()>m_size)
+         break;
+      m_records.push_back(offset);
+      offset += header->GetRecordSize();
+   }
+   return true;
+}
+
+void ArchiveReader::Close()
+{
+   if (m_map) {
+      munmap((void*)m_map, m_size);
+      m_map = NULL;
+   }
+   m_size = 0;
+   m_records.clear();
+}
+
+const MissionHeader* ArchiveReader::GetHeader(int mission)
+{
+   if (mission<0 || mission>=(int)m_records.size())
+      return NULL;
+   return (const MissionHeader*)(m_map+m_records[mission]);
+}
+
+/**
+ * @brief Returns the header of the record at file offset @p offset
+ * 
+ * @return const MissionHeader*: NULL if there is no valid, complete record at @p offset.
+ */
+const MissionHeader* ArchiveReader::GetHeaderAt(uint64_t offset)
+{
+   if (offset%8!=0 || offset+sizeof(MissionHeader)>m_size) {
+      m_lastError = "Invalid archive offset";
+      return NULL;
+   }
+   const MissionHeader* header = (const MissionHeader*)(m_map+offset);
+   if (memcmp(header->magic, archiveMagic, sizeof(archiveMagic))!=0 || header->headerSize<sizeof(MissionHeader)) {
+      m_lastError = "Invalid archive record";
+      return NULL;
+   }
+   if (offset+header->GetRecordSize()>m_size) {
+      m_lastError = "Truncated archive record";
+      return NULL;
+   }
+   return header;
+}
+
+/**
+ * @brief Returns the sample data of a mission as stored in the file
+ */
+const uint8_t* ArchiveReader::GetData(int mission)
+{
+   const MissionHeader* header = GetHeader(mission);
+   if (!header)
+      return NULL;
+   return (const uint8_t*)header + header->headerSize;
+}
+
+/**
+ * @brief Decodes all sample data of a mission to raw values
+ * 
+ * A raw value is the high byte * 256 + the low byte in high resolution mode, else the single byte.
+ * @param int32_t* buffer: room for sampleCount values
+ */
+bool ArchiveReader::GetRawValues(int mission, int32_t* buffer)
+{
+   const MissionHeader* header = GetHeader(mission);
+   if (!header) {
+      m_lastError = "No such mission";
+      return false;
+   }
+   return GetRawValues(header, buffer, header->sampleCount);
+}
+
+/**
+ * @brief Decodes the first @p count samples of the record of @p header to raw values
+ * 
+ * Only the part of the sample data up to sample @p count is decoded.
+ */
+bool ArchiveReader::GetRawValues(const MissionHeader* header, int32_t* buffer, int count)
+{
+   if (count>(int)header->sampleCount) {
+      m_lastError = "Samples not available";
+      return false;
+   }
+   const uint8_t* data = (const uint8_t*)header + header->headerSize;
+   if (header->encoding==MissionHeader::ENCODING_DELTA) {
+      if (!SampleCodec::Decode(data, header->dataSize, buffer, count)) {
+         m_lastError = "Corrupt sample data";
+         return false;
+      }
+   } else if (header->encoding==MissionHeader::ENCODING_RAW) {
+      if (header->dataSize<header->sampleCount*header->bytesPerSample) {
+         m_lastError = "Corrupt sample data";
+         return false;
+      }
+      for (int i=0; i<count; i++)
+         buffer[i] = header->bytesPerSample==2 ? data[i*2]<<8 | data[i*2+1] : data[i];
+   } else {
+      m_lastError = "Unknown sample encoding";
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Converts @p count samples of a mission to °C, starting with stored sample @p first
+ * 
+ * @return int: the number of values written to @p buffer.
+ */
+int ArchiveReader::GetValues(int mission, double* buffer, int first, int count)
+{
+   const MissionHeader* header = GetHeader(mission);
+   if (!header || first<0)
+      return 0;
+   if (first+count>(int)header->sampleCount)
+      count = header->sampleCount-first;
+   if (count<=0)
+      return 0;
+   std::vector<int32_t> values(first+count);
+   if (!GetRawValues(header, values.data(), first+count))
+      return 0;
+   header->ConvertValues(values.data()+first, count, buffer);
+   return count;
+}
+
+/**
+ * @brief Rebuilds the snapshot of the logger at the readout of @p mission
+ * 
+ * The stored samples are converted back into the raw format of the logging memory, so the snapshot can be
+ * decoded the same way as one taken from a device.
+ */
+bool ArchiveReader::GetSnapshot(int mission, DS1922Snapshot& snapshot)
+{
+   const MissionHeader* header = GetHeader(mission);
+   if (!header) {
+      m_lastError = "No such mission";
+      return false;
+   }
+   std::vector<int32_t> values(header->sampleCount);
+   if (!GetRawValues(header, values.data(), header->sampleCount))
+      return false;
+   std::vector<uint8_t> log(header->sampleCount*header->bytesPerSample);
+   for (uint32_t i=0; i<header->sampleCount; i++)
+   {
+      if (header->bytesPerSample==2) {
+         log[i*2] = values[i]>>8;
+         log[i*2+1] = values[i]&0xFF;
+      } else {
+         log[i] = values[i];
+      }
+   }
+   snapshot = DS1922Snapshot(header->rom, header->registerPages,
+      (header->flags & MissionHeader::FLAG_CALIBRATION) ? header->calibration : NULL,
+      log.data(), header->firstSample, header->sampleCount);
+   return true;
+}
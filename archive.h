@@ -0,0 +1,137 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class DS1922Snapshot;
+
+class DS1922;
+
+/**
+ * @brief Header of a mission record in an archive file
+ * 
+ * An archive file is a sequence of records. Each record is this header, followed by dataSize bytes of sample data,
+ * padded to a multiple of 8 bytes. With ENCODING_RAW, the sample data are the raw values as stored in the DS1922,
+ * 1 byte per sample or 2 bytes (high byte first) in high resolution mode, see DS1922::ReadRawSamples().
+ * With ENCODING_DELTA, the raw values (high byte * 256 + low byte in high resolution mode) are compressed
+ * with SampleCodec.
+ * All fields are stored in host byte order (little endian on all supported platforms).
+ */
+struct MissionHeader
+{
+   char magic[4];             // "QIBM"
+   uint16_t version;
+   uint16_t headerSize;       // sizeof(MissionHeader), offset of the sample data
+   uint64_t rom;              // ROM ID of the logger, 0 if unknown
+   uint8_t type;              // DS1922::Type
+   uint8_t flags;             // FLAG_...
+   uint8_t bytesPerSample;    // 1 or 2
+   uint8_t encoding;          // ENCODING_...
+   uint32_t interval;         // seconds between samples
+   int64_t missionStart;      // time of the first sample of the mission, seconds since epoch
+   int64_t readoutTime;       // "
+   uint32_t missionSamples;   // mission sample counter at readout
+   uint32_t firstSample;      // mission sample number of the first stored sample, >0 after rollover
+   uint32_t sampleCount;      // number of stored samples
+   uint32_t dataSize;         // bytes of sample data, as encoded
+   double calibration[3];     // only valid with FLAG_CALIBRATION
+   uint8_t registerPages[64]; // configuration memory pages 0x0200-0x023F at readout
+   
+   enum Flags {FLAG_HIGHRES=0x01, FLAG_ROLLOVER=0x02, FLAG_CALIBRATION=0x04};
+   enum Encodings {ENCODING_RAW=0, ENCODING_DELTA=1};
+   
+   double ConvertValue(int32_t raw) const;
+   void ConvertValues(const int32_t* raw, int count, double* buffer) const;
+   size_t GetRecordSize() const {return (headerSize + dataSize + 7) / 8 * 8;}
+};
+static_assert(sizeof(MissionHeader)==144, "archive format changed");
+
+/**
+ * @brief Appends downloaded missions to an archive file
+ * 
+ * Functions return false on error, and the error message can be retrieved using GetLastError().
+ */
+class ArchiveWriter
+{
+public:
+   ArchiveWriter();
+   ~ArchiveWriter();
+   
+public:
+   std::string GetLastError() {return m_lastError;}
+   bool Open(const char* fileName);
+   void Close();
+   void SetEncoding(int encoding) {m_encoding = encoding;}
+   bool Append(DS1922& ds1922, int first=0, MissionHeader* written=NULL, uint64_t* offset=NULL);
+   bool Append(const DS1922Snapshot& snapshot, int first=0, MissionHeader* written=NULL, uint64_t* offset=NULL);
+   bool Append(const MissionHeader& header, const uint8_t* data, uint64_t* offset=NULL);
+   static void FillHeader(DS1922& ds1922, MissionHeader& header);
+   static void FillHeader(const DS1922Snapshot& snapshot, MissionHeader& header);
+   
+protected:
+   bool AppendEncoded(MissionHeader& header, std::vector<uint8_t>& data, MissionHeader* written, uint64_t* offset);
+   
+   // Data
+private:
+   std::string m_lastError;
+   int m_fd;
+   int m_encoding;   // MissionHeader::ENCODING_... used by Append(DS1922&)
+};
+
+/**
+ * @brief Reads an archive file through a read-only memory mapping
+ * 
+ * Open() only walks the record headers to index them. Headers and sample data are accessed in place, without
+ * copying; the pointers stay valid until Close(). Encoded sample data are decoded by GetRawValues() and
+ * GetValues(). Without indexing, records can still be accessed by their file offset with GetHeaderAt().
+ */
+class ArchiveReader
+{
+public:
+   ArchiveReader();
+   ~ArchiveReader();
+   
+public:
+   std::string GetLastError() {return m_lastError;}
+   bool Open(const char* fileName, bool index=true);
+   void Close();
+   size_t GetSize() {return m_size;}
+   int GetMissionCount() {return m_records.size();}
+   const MissionHeader* GetHeader(int mission);
+   const MissionHeader* GetHeaderAt(uint64_t offset);
+   const uint8_t* GetData(int mission);
+   bool GetRawValues(int mission, int32_t* buffer);
+   bool GetRawValues(const MissionHeader* header, int32_t* buffer, int count);
+   int GetValues(int mission, double* buffer, int first, int count);
+   bool GetSnapshot(int mission, DS1922Snapshot& snapshot);
+   
+   // Data
+private:
+   std::string m_lastError;
+   const uint8_t* m_map;
+   size_t m_size;
+   std::vector<size_t> m_records;   // offsets of the headers
+};
+
+#endif // ARCHIVE_H
@@ -0,0 +1,57 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "busarbiter.h"
+
+
+BusArbiter::BusArbiter()
+{
+   m_depth = 0;
+   m_nextTicket = 0;
+}
+
+/**
+ * @brief Waits until the bus is free and no waiting thread has a higher priority, then takes the bus
+ */
+void BusArbiter::Acquire(Priority priority)
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   std::thread::id self = std::this_thread::get_id();
+   if (m_depth>0 && m_owner==self) {
+      m_depth++;
+      return;
+   }
+   std::pair<int, uint64_t> ticket(-priority, m_nextTicket++);
+   m_waiting.insert(ticket);
+   while (m_depth>0 || *m_waiting.begin()!=ticket) {
+      m_released.wait(lock);
+   }
+   m_waiting.erase(m_waiting.begin());
+   m_owner = self;
+   m_depth = 1;
+}
+
+void BusArbiter::Release()
+{
+   std::unique_lock<std::mutex> lock(m_mutex);
+   if (--m_depth==0) {
+      m_owner = std::thread::id();
+      m_released.notify_all();
+   }
+}
@@ -0,0 +1,70 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUSARBITER_H
+#define BUSARBITER_H
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <set>
+#include <utility>
+#include <cstdint>
+
+/**
+ * @brief Serializes the 1-Wire transactions of several threads sharing one DS9490
+ * 
+ * Threads waiting for the bus are queued by priority, and in order of arrival within the same priority.
+ * A transaction should be short, e.g. a single memory page, so that waiting interactive requests are served
+ * in between the pages of a background download. The arbiter is re-entrant: the thread owning the bus can
+ * acquire it again, e.g. when a DS1922 transaction calls DS9490 functions.
+ * Use the Transaction class to hold the bus for the lifetime of a scope.
+ */
+class BusArbiter
+{
+public:
+   BusArbiter();
+   
+public:
+   enum Priority {Background=0, Normal=1, Interactive=2};
+   void Acquire(Priority priority);
+   void Release();
+   
+   class Transaction
+   {
+   public:
+      Transaction(BusArbiter* arbiter, Priority priority) : m_arbiter(arbiter) {m_arbiter->Acquire(priority);}
+      ~Transaction() {m_arbiter->Release();}
+   private:
+      Transaction(const Transaction&);
+      Transaction& operator=(const Transaction&);
+      BusArbiter* m_arbiter;
+   };
+   
+   // Data
+private:
+   std::mutex m_mutex;
+   std::condition_variable m_released;
+   std::thread::id m_owner;
+   int m_depth;
+   uint64_t m_nextTicket;
+   // waiting threads, ordered by priority (negated for descending order), then ticket
+   std::set<std::pair<int, uint64_t> > m_waiting;
+};
+
+#endif // BUSARBITER_H
@@ -0,0 +1,127 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "bustopology.h"
+#include "ds9490.h"
+#include "ds1922.h"
+#include <list>
+#include <algorithm>
+
+
+/**
+ * @brief Constructor
+ * 
+ * @param DS9490* ds9490: the adapter of the bus, which needs to have a lifetime longer than this object.
+ */
+BusTopology::BusTopology(DS9490* ds9490)
+{
+   m_ds9490 = ds9490;
+   m_valid = false;
+   m_searchCount = 0;
+}
+
+/**
+ * @brief Updates the list of loggers, and appends the changes to @p events
+ * 
+ * With @p full, the bus is searched even if no new device was reported, e.g. as periodic safeguard.
+ */
+bool BusTopology::Rescan(std::vector<Event>& events, bool full)
+{
+   if (!m_valid || full || m_ds9490->GetDeviceAttached())
+      return Search(events);
+   std::vector<uint64_t> present;
+   present.reserve(m_roms.size());
+   for (size_t i=0; i<m_roms.size(); i++)
+   {
+      DS1922 ds1922(m_ds9490, m_roms[i]);
+      bool found;
+      if (!ds1922.CheckPresence(found)) {
+         m_error = ds1922.GetError();
+         return false;
+      }
+      if (found) {
+         present.push_back(m_roms[i]);
+      } else {
+         Event event;
+         event.rom = m_roms[i];
+         event.added = false;
+         events.push_back(event);
+      }
+   }
+   m_roms.swap(present);
+   // a device attached during the checks
+   if (m_ds9490->GetDeviceAttached())
+      return Search(events);
+   return true;
+}
+
+/**
+ * @brief Searches the bus and reports the differences to the cached list
+ */
+bool BusTopology::Search(std::vector<Event>& events)
+{
+   std::list<uint64_t> serials;
+   m_ds9490->GetDeviceAttached();   // reported devices are found by this search
+   if (!m_ds9490->Scan1WBus(serials, DS1922::m_familyCode)) {
+      m_error = m_ds9490->GetError();
+      m_valid = false;
+      return false;
+   }
+   m_searchCount++;
+   std::vector<uint64_t> roms(serials.begin(), serials.end());
+   std::sort(roms.begin(), roms.end());
+   roms.erase(std::unique(roms.begin(), roms.end()), roms.end());
+   // merge both sorted lists
+   size_t i = 0, j = 0;
+   while (i<m_roms.size() || j<roms.size())
+   {
+      Event event;
+      if (j==roms.size() || (i<m_roms.size() && m_roms[i]<roms[j])) {
+         event.rom = m_roms[i++];
+         event.added = false;
+      } else if (i==m_roms.size() || roms[j]<m_roms[i]) {
+         event.rom = roms[j++];
+         event.added = true;
+      } else {
+         i++;
+         j++;
+         continue;
+      }
+      events.push_back(event);
+   }
+   m_roms.swap(roms);
+   m_valid = true;
+   return true;
+}
+
+/**
+ * @brief Forgets the cached list, e.g. after the adapter was reopened
+ * 
+ * The next Rescan() searches the bus and reports all loggers as added.
+ */
+void BusTopology::Clear()
+{
+   m_roms.clear();
+   m_valid = false;
+}
+
+bool BusTopology::Contains(uint64_t rom)
+{
+   return std::binary_search(m_roms.begin(), m_roms.end(), rom);
+}
@@ -0,0 +1,68 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef BUSTOPOLOGY_H
+#define BUSTOPOLOGY_H
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "deviceerror.h"
+
+class DS9490;
+
+/**
+ * @brief Cached list of the DS1922 loggers on the bus of one DS9490
+ * 
+ * A full search of the bus takes three USB round trips per ROM bit and device. Rescan() therefore only searches
+ * the bus if the cache is new, a full scan was requested, or the DS2490 reported a newly attached device.
+ * Otherwise each known logger is verified by DS1922::CheckPresence(), which costs one reset. The changes are
+ * returned as add and remove events. The ROM IDs are kept sorted in a vector, see GetRoms().
+ */
+class BusTopology
+{
+public:
+   BusTopology(DS9490* ds9490);
+   
+public:
+   struct Event
+   {
+      uint64_t rom;
+      bool added;             // false if removed
+   };
+   
+   std::string GetLastError() {return m_error.ToString();}
+   const DeviceError& GetError() {return m_error;}
+   bool Rescan(std::vector<Event>& events, bool full=false);
+   void Clear();
+   const std::vector<uint64_t>& GetRoms() {return m_roms;}
+   bool Contains(uint64_t rom);
+   int GetSearchCount() {return m_searchCount;}
+protected:
+   bool Search(std::vector<Event>& events);
+   
+   // Data
+private:
+   DeviceError m_error;
+   DS9490* m_ds9490;
+   std::vector<uint64_t> m_roms;   // sorted
+   bool m_valid;                   // m_roms reflects a full search
+   int m_searchCount;
+};
+
+#endif // BUSTOPOLOGY_H
@@ -0,0 +1,240 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <math.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "collector.h"
+#include "samplecodec.h"
+#include "daemon.h"
+
+using namespace std;
+
+/*
+ * Protocol on the Unix domain socket: one command per line, every reply ends with a line ".".
+ *   LIST              one line per logger: ROM ID, adapter, mission start, sample interval [s],
+ *                     first buffered sample, number of buffered samples, lost samples,
+ *                     next readout, last error
+ *   DATA <rom> [from] one line per buffered sample from mission sample number <from> on:
+ *                     sample number, time, value [°C]
+ *   PACK <rom> [from] the same samples in one line: first sample number, its time, sample interval [s],
+ *                     number of samples, and the values in 1/512 °C compressed with SampleCodec, base64 encoded
+ *   SCAN              rescan all busses now
+ */
+
+struct Client
+{
+   int fd;
+   string input;
+};
+
+static bool SendReply(int fd, const string& reply)
+{
+   size_t sent = 0;
+   while (sent<reply.size()) {
+      ssize_t result = send(fd, reply.data()+sent, reply.size()-sent, MSG_NOSIGNAL);
+      if (result<=0)
+         return false;
+      sent += result;
+   }
+   return true;
+}
+
+static void AppendBase64(string& output, const vector<uint8_t>& data)
+{
+   static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+   for (size_t i=0; i<data.size(); i+=3)
+   {
+      uint32_t group = data[i]<<16;
+      if (i+1<data.size())
+         group |= data[i+1]<<8;
+      if (i+2<data.size())
+         group |= data[i+2];
+      output += digits[group>>18 & 0x3F];
+      output += digits[group>>12 & 0x3F];
+      output += i+1<data.size() ? digits[group>>6 & 0x3F] : '=';
+      output += i+2<data.size() ? digits[group & 0x3F] : '=';
+   }
+}
+
+static string HandleCommand(Collector& collector, const string& line)
+{
+   char command[16] = "";
+   char romString[32] = "";
+   long from = 0;
+   sscanf(line.c_str(), "%15s %31s %ld", command, romString, &from);
+   string reply;
+   char buffer[256];
+   const map<uint64_t, Collector::Logger>& loggers = collector.GetLoggers();
+   
+   if (strcmp(command, "LIST")==0) {
+      for (map<uint64_t, Collector::Logger>::const_iterator it=loggers.begin(); it!=loggers.end(); ++it)
+      {
+         const Collector::Logger& logger = it->second;
+         snprintf(buffer, sizeof(buffer), "%016lx %d %ld %d %d %zu %d %ld %s\n",
+                  logger.rom, logger.adapter, (long)logger.missionTimestamp, logger.interval,
+                  logger.firstSample, logger.samples.size(), logger.lostSamples,
+                  (long)logger.nextReadout, logger.lastError.code==DeviceError::NONE ? "ok" : logger.lastError.ToString().c_str());
+         reply += buffer;
+      }
+   } else if (strcmp(command, "DATA")==0 || strcmp(command, "PACK")==0) {
+      uint64_t rom = strtoull(romString, NULL, 16);
+      map<uint64_t, Collector::Logger>::const_iterator it = loggers.find(rom);
+      if (it==loggers.end()) {
+         reply += "ERR unknown logger\n";
+      } else {
+         const Collector::Logger& logger = it->second;
+         long first = from - logger.firstSample;
+         if (first<0)
+            first = 0;
+         if (first>(long)logger.samples.size())
+            first = logger.samples.size();
+         if (command[0]=='P') {
+            // the calibrated values are not on the raw grid anymore, 1/512 °C is below the sensor resolution
+            vector<int32_t> values(logger.samples.size()-first);
+            for (size_t i=0; i<values.size(); i++)
+               values[i] = lround(logger.samples[first+i]*512);
+            vector<uint8_t> packed;
+            SampleCodec::Encode(values.data(), values.size(), packed);
+            long sample = logger.firstSample + first;
+            snprintf(buffer, sizeof(buffer), "%ld %ld %d %zu ", sample,
+                     (long)logger.missionTimestamp + sample*logger.interval, logger.interval, values.size());
+            reply += buffer;
+            AppendBase64(reply, packed);
+            reply += "\n";
+         }
+         for (long i=first; command[0]=='D' && i<(long)logger.samples.size(); i++)
+         {
+            long sample = logger.firstSample + i;
+            snprintf(buffer, sizeof(buffer), "%ld %ld %g\n", sample,
+                     (long)logger.missionTimestamp + sample*logger.interval, logger.samples[i]);
+            reply += buffer;
+         }
+      }
+   } else if (strcmp(command, "SCAN")==0) {
+      if (!collector.Scan())
+         reply += "ERR " + collector.GetLastError() + "\n";
+      collector.ReadDue(time(NULL));
+   } else {
+      reply += "ERR unknown command\n";
+   }
+   reply += ".\n";
+   return reply;
+}
+
+/**
+ * @brief Runs the collector, serving the downloaded data on a Unix domain socket
+ * 
+ * The busses are rescanned every @p scanInterval seconds. Does not return unless the socket cannot be created.
+ */
+int RunDaemon(const char* socketPath, int scanInterval)
+{
+   int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (listenFd<0) {
+      perror("socket");
+      return 1;
+   }
+   sockaddr_un address;
+   memset(&address, 0, sizeof(address));
+   address.sun_family = AF_UNIX;
+   strncpy(address.sun_path, socketPath, sizeof(address.sun_path)-1);
+   unlink(socketPath);
+   if (bind(listenFd, (sockaddr*)&address, sizeof(address))!=0 || listen(listenFd, 8)!=0) {
+      perror(socketPath);
+      close(listenFd);
+      return 1;
+   }
+   signal(SIGPIPE, SIG_IGN);
+   
+   Collector collector;
+   vector<Client> clients;
+   time_t nextScan = 0;
+   while (true) {
+      time_t now = time(NULL);
+      if (now>=nextScan) {
+         if (!collector.Scan())
+            cerr << collector.GetLastError() << endl;
+         nextScan = now + scanInterval;
+      }
+      collector.ReadDue(now);
+      // one page of every running readout, then serve the clients
+      collector.Step();
+      
+      now = time(NULL);
+      time_t wakeup = nextScan;
+      time_t nextDue = collector.GetNextDue();
+      if (nextDue!=0 && nextDue<wakeup)
+         wakeup = nextDue;
+      int timeout = wakeup>now ? (wakeup-now)*1000 : 0;
+      if (collector.IsBusy())
+         timeout = 0;
+      
+      vector<pollfd> fds(clients.size()+1);
+      fds[0].fd = listenFd;
+      fds[0].events = POLLIN;
+      for (size_t i=0; i<clients.size(); i++)
+      {
+         fds[i+1].fd = clients[i].fd;
+         fds[i+1].events = POLLIN;
+      }
+      if (poll(&fds[0], fds.size(), timeout)<=0)
+         continue;
+      
+      for (size_t i=clients.size(); i>0; i--)
+      {
+         if (!fds[i].revents)
+            continue;
+         Client& client = clients[i-1];
+         char buffer[256];
+         ssize_t result = read(client.fd, buffer, sizeof(buffer));
+         bool ok = result>0;
+         if (ok) {
+            client.input.append(buffer, result);
+            size_t end;
+            while (ok && (end=client.input.find('\n'))!=string::npos) {
+               ok = SendReply(client.fd, HandleCommand(collector, client.input.substr(0, end)));
+               client.input.erase(0, end+1);
+            }
+         }
+         if (!ok) {
+            close(client.fd);
+            clients.erase(clients.begin()+(i-1));
+         }
+      }
+      if (fds[0].revents & POLLIN) {
+         int fd = accept(listenFd, NULL, NULL);
+         if (fd>=0) {
+            Client client;
+            client.fd = fd;
+            clients.push_back(client);
+         }
+      }
+   }
+   return 0;
+}
@@ -16,41 +16,740 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <iostream>
+#include <vector>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include <locale.h>
 
 #include "ds1922.h"
+#include "ds1922snapshot.h"
 #include "ds9490.h"
+#include "presencewatcher.h"
+#include "csvexporter.h"
+#include "archive.h"
+#include "store.h"
+#include "jsonwriter.h"
+#include "missionstatistics.h"
+#include "provisioner.h"
+#include "livemonitor.h"
+#include "daemon.h"
 
 using namespace std;
 
+void PrintConfig(DS1922& ds1922)
+{
+   tm time;
+   ds1922.GetRtc(&time);
+   cout << "Clock enabled: " << ds1922.GetRtcEnabled() << endl;
+   time_t tt = mktime(&time);
+   char buffer[64];
+   strftime(buffer, 64, "%x %X", localtime(&tt));
+   printf("Clock: %s\n", buffer);
+   cout << "Mission in progress: " << ds1922.GetMissionInProgress() << endl;
+   cout << "Sample rate: " << ds1922.GetSampleRate() << endl;
+   cout << "Sample rate high res: " << ds1922.GetHighResLogging() << endl;
+   cout << "Sample count: " << ds1922.GetSampleCount() << endl;
+   cout << "Device sample count: " << ds1922.GetDeviceSampleCount() << endl;
+   cout << "Start upon alarm: " << ds1922.GetStartUponAlarm() << endl;
+   cout << "Alarm activated: low temp: " << ds1922.GetAlarmLow()
+      << ", high temp: " << ds1922.GetAlarmHigh() << endl;
+   cout << "Alarm low temp: " << ds1922.GetAlarmLow()
+      << ", high temp: " << ds1922.GetAlarmHigh() << endl;
+   cout << "Waiting for alarm: " << ds1922.GetWaitingForAlarm() << endl;
+   cout << "Logging enabled: " << ds1922.GetLoggingEnabled() << endl;
+   cout << "Rollover: " << ds1922.GetRollover() << endl;
+   cout << "Mission start delay: " << ds1922.GetMissionStartDelay() << endl;
+   ds1922.GetMissionTimestamp(&time);
+   tt = mktime(&time);
+   strftime(buffer, 64, "%x %X", localtime(&tt));
+   printf("Mission timestamp: %s\n", buffer);
+}
+
+static string FormatDuration(long seconds)
+{
+   char buffer[32];
+   snprintf(buffer, sizeof(buffer), "%ld:%02ld:%02ld", seconds/3600, seconds/60%60, seconds%60);
+   return buffer;
+}
+
+void PrintStatistics(MissionStatistics& statistics)
+{
+   cout << "Samples: " << statistics.GetCount() << endl;
+   cout << "Min: " << statistics.GetMin() << ", max: " << statistics.GetMax()
+      << ", mean: " << statistics.GetMean() << endl;
+   cout << "Mean kinetic temperature: " << statistics.GetMeanKinetic() << endl;
+   cout << "Below " << statistics.GetLowThreshold() << ": " << statistics.GetSamplesBelow() << " samples ("
+      << FormatDuration(statistics.GetTimeBelow()) << "), " << statistics.GetExcursionsBelow()
+      << " excursions, longest " << statistics.GetLongestBelow() << " samples" << endl;
+   cout << "Above " << statistics.GetHighThreshold() << ": " << statistics.GetSamplesAbove() << " samples ("
+      << FormatDuration(statistics.GetTimeAbove()) << "), " << statistics.GetExcursionsAbove()
+      << " excursions, longest " << statistics.GetLongestAbove() << " samples" << endl;
+}
+
+/**
+ * @brief Prints the samples held by @p snapshot if @p samples is true, and their statistics if
+ * @p statistics is true
+ */
+bool PrintData(const DS1922Snapshot& snapshot, bool samples, bool statistics)
+{
+   time_t tt = snapshot.GetMissionTimestamp();
+   // with rollover, only the newest samples were still available
+   int firstSample = snapshot.GetFirstSample();
+   int sampleRate = snapshot.GetInterval();
+   vector<double> values(snapshot.GetLogSamples());
+   snapshot.GetValues(values.data(), firstSample, values.size());
+   if (samples) {
+      cout.flush();
+      CsvExporter exporter(STDOUT_FILENO, ": ");
+      if (!exporter.Write(values.data(), values.size(), tt+(time_t)sampleRate*firstSample, sampleRate)
+            || !exporter.Flush()) {
+         cerr << exporter.GetLastError() << endl;
+         return false;
+      }
+   }
+   if (statistics) {
+      if (samples)
+         cout << "-Statistics--------------------------------------" << endl;
+      MissionStatistics missionStatistics;
+      missionStatistics.Compute(values.data(), values.size(), sampleRate, snapshot.GetAlarmLowThreshold(),
+                                snapshot.GetAlarmHighThreshold());
+      PrintStatistics(missionStatistics);
+   }
+   return true;
+}
+
+/**
+ * @brief Prints all missions of an archive file
+ */
+int PrintArchive(const char* fileName)
+{
+   ArchiveReader reader;
+   if (!reader.Open(fileName)) {
+      cerr << reader.GetLastError() << endl;
+      return 1;
+   }
+   for (int i=0; i<reader.GetMissionCount(); i++) {
+      const MissionHeader* header = reader.GetHeader(i);
+      vector<double> values(header->sampleCount);
+      if (values.size()>0 && reader.GetValues(i, values.data(), 0, values.size())==0) {
+         cerr << "Mission " << i << ": " << reader.GetLastError() << endl;
+         return 1;
+      }
+      time_t start = header->missionStart + (time_t)header->firstSample*header->interval;
+      char buffer[64];
+      strftime(buffer, 64, "%F %X", localtime(&start));
+      printf("# Mission %d: device %016lx, %u samples from %s, interval %u s\n", i, header->rom,
+             header->sampleCount, buffer, header->interval);
+      fflush(stdout);
+      CsvExporter exporter(STDOUT_FILENO, ": ");
+      if (!exporter.Write(values.data(), values.size(), start, header->interval) || !exporter.Flush()) {
+         cerr << exporter.GetLastError() << endl;
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/**
+ * @brief Parses "YYYY-MM-DD[ HH:MM[:SS]]" as local time
+ */
+bool ParseTime(const char* text, time_t& result)
+{
+   static const char* formats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%d"};
+   for (size_t i=0; i<sizeof(formats)/sizeof(formats[0]); i++)
+   {
+      tm time;
+      memset(&time, 0, sizeof(time));
+      const char* end = strptime(text, formats[i], &time);
+      if (end && *end==0) {
+         time.tm_isdst = -1;
+         result = mktime(&time);
+         return true;
+      }
+   }
+   return false;
+}
+
+/**
+ * @brief Prints the samples of a logger in a time range from a store, or the loggers in the store
+ * 
+ * Arguments: store [rom [from [to]]]
+ */
+int Query(int argc, char** argv)
+{
+   if (argc<2) {
+      cerr << "Usage: ibutton query store [rom [from [to]]]" << endl;
+      return 1;
+   }
+   MissionStore store;
+   if (!store.Open(argv[1])) {
+      cerr << store.GetLastError() << endl;
+      return 1;
+   }
+   if (argc<3) {
+      vector<uint64_t> roms = store.GetRoms();
+      for (size_t i=0; i<roms.size(); i++)
+         printf("%016lx\n", roms[i]);
+      return 0;
+   }
+   uint64_t rom = strtoull(argv[2], NULL, 16);
+   time_t from = 0, to = INT64_MAX;
+   if ((argc>3 && !ParseTime(argv[3], from)) || (argc>4 && !ParseTime(argv[4], to))) {
+      cerr << "Invalid time, use YYYY-MM-DD[ HH:MM[:SS]]" << endl;
+      return 1;
+   }
+   vector<MissionStore::Segment> segments;
+   if (!store.Query(rom, from, to, segments)) {
+      cerr << store.GetLastError() << endl;
+      return 1;
+   }
+   CsvExporter exporter(STDOUT_FILENO, ": ");
+   for (size_t i=0; i<segments.size(); i++)
+   {
+      const MissionStore::Segment& segment = segments[i];
+      if (!exporter.Write(segment.values.data(), segment.values.size(), segment.start, segment.interval)) {
+         cerr << exporter.GetLastError() << endl;
+         return 1;
+      }
+   }
+   if (!exporter.Flush()) {
+      cerr << exporter.GetLastError() << endl;
+      return 1;
+   }
+   return 0;
+}
+
+static const char* TypeName(DS1922::Type type)
+{
+   switch (type) {
+      case DS1922::DS1922L: return "DS1922L";
+      case DS1922::DS1922T: return "DS1922T";
+      case DS1922::DS1922E: return "DS1922E";
+      default: return "unknown";
+   }
+}
+
+/**
+ * @brief Writes the configuration and samples of a logger as JSON
+ * 
+ * @p mode is "array" (samples as an array of values), "rle" (samples as an array of [value, repeat count])
+ * or "lines" (one JSON line per sample following the logger object).
+ */
+bool WriteLoggerJson(JsonWriter& json, DS1922& ds1922, int adapter, const char* mode)
+{
+   json.BeginObject();
+   json.Key("adapter");
+   json.Int(adapter);
+   json.Key("rom");
+   json.Hex(ds1922.GetRom());
+   if (!ds1922.ReadRegister()) {
+      json.Key("error");
+      json.String(ds1922.GetLastError().c_str());
+      json.EndObject();
+      return json.EndLine();
+   }
+   tm time;
+   ds1922.GetRtc(&time);
+   time.tm_isdst = -1;
+   time_t rtc = mktime(&time);
+   ds1922.GetMissionTimestamp(&time);
+   time.tm_isdst = -1;
+   time_t missionStart = mktime(&time);
+   int interval = ds1922.GetSampleRate() * (ds1922.GetHighspeedSampling() ? 1 : 60);
+   int sampleCount = ds1922.GetSampleCount();
+   int firstSample = sampleCount - ds1922.GetLogCapacity();
+   if (firstSample<0)
+      firstSample = 0;
+   
+   json.Key("type");
+   json.String(TypeName(ds1922.GetType()));
+   json.Key("config");
+   json.BeginObject();
+   json.Key("rtcEnabled");
+   json.Bool(ds1922.GetRtcEnabled());
+   json.Key("rtc");
+   json.Int(rtc);
+   json.Key("missionInProgress");
+   json.Bool(ds1922.GetMissionInProgress());
+   json.Key("sampleRate");
+   json.Int(ds1922.GetSampleRate());
+   json.Key("highspeedSampling");
+   json.Bool(ds1922.GetHighspeedSampling());
+   json.Key("highResLogging");
+   json.Bool(ds1922.GetHighResLogging());
+   json.Key("rollover");
+   json.Bool(ds1922.GetRollover());
+   json.Key("startUponAlarm");
+   json.Bool(ds1922.GetStartUponAlarm());
+   json.Key("missionStartDelay");
+   json.Int(ds1922.GetMissionStartDelay());
+   json.Key("loggingEnabled");
+   json.Bool(ds1922.GetLoggingEnabled());
+   json.Key("waitingForAlarm");
+   json.Bool(ds1922.GetWaitingForAlarm());
+   json.Key("alarmLowEnabled");
+   json.Bool(ds1922.GetAlarmLowEnabled());
+   json.Key("alarmLowThreshold");
+   json.Double(ds1922.GetAlarmLowThreshold());
+   json.Key("alarmHighEnabled");
+   json.Bool(ds1922.GetAlarmHighEnabled());
+   json.Key("alarmHighThreshold");
+   json.Double(ds1922.GetAlarmHighThreshold());
+   json.Key("alarmLow");
+   json.Bool(ds1922.GetAlarmLow());
+   json.Key("alarmHigh");
+   json.Bool(ds1922.GetAlarmHigh());
+   json.EndObject();
+   json.Key("missionStart");
+   json.Int(missionStart);
+   json.Key("interval");
+   json.Int(interval);
+   json.Key("missionSamples");
+   json.Int(sampleCount);
+   json.Key("firstSample");
+   json.Int(firstSample);
+   
+   vector<double> values(sampleCount-firstSample);
+   if (!values.empty() && !ds1922.ReadSamples(values.data(), firstSample, values.size())) {
+      json.Key("error");
+      json.String(ds1922.GetLastError().c_str());
+      json.EndObject();
+      return json.EndLine();
+   }
+   MissionStatistics statistics;
+   statistics.Compute(ds1922, values.data(), values.size());
+   json.Key("statistics");
+   json.BeginObject();
+   json.Key("count");
+   json.Int(statistics.GetCount());
+   json.Key("min");
+   json.Double(statistics.GetMin());
+   json.Key("max");
+   json.Double(statistics.GetMax());
+   json.Key("mean");
+   json.Double(statistics.GetMean());
+   json.Key("meanKinetic");
+   json.Double(statistics.GetMeanKinetic());
+   json.Key("timeBelow");
+   json.Int(statistics.GetTimeBelow());
+   json.Key("timeAbove");
+   json.Int(statistics.GetTimeAbove());
+   json.Key("excursionsBelow");
+   json.Int(statistics.GetExcursionsBelow());
+   json.Key("excursionsAbove");
+   json.Int(statistics.GetExcursionsAbove());
+   json.Key("longestBelow");
+   json.Int(statistics.GetLongestBelow());
+   json.Key("longestAbove");
+   json.Int(statistics.GetLongestAbove());
+   json.EndObject();
+   bool lines = strcmp(mode, "lines")==0;
+   if (!lines) {
+      bool rle = strcmp(mode, "rle")==0;
+      json.Key("samples");
+      json.BeginArray();
+      for (size_t i=0; i<values.size(); )
+      {
+         size_t repeat = 1;
+         while (rle && i+repeat<values.size() && values[i+repeat]==values[i])
+            repeat++;
+         if (rle) {
+            json.BeginArray();
+            json.Double(values[i]);
+            json.Int(repeat);
+            json.EndArray();
+         } else {
+            json.Double(values[i]);
+         }
+         i += repeat;
+      }
+      json.EndArray();
+   }
+   json.EndObject();
+   bool ok = json.EndLine();
+   for (size_t i=0; lines && ok && i<values.size(); i++)
+   {
+      json.BeginObject();
+      json.Key("rom");
+      json.Hex(ds1922.GetRom());
+      json.Key("sample");
+      json.Int(firstSample+i);
+      json.Key("time");
+      json.Int(missionStart+(time_t)(firstSample+i)*interval);
+      json.Key("value");
+      json.Double(values[i]);
+      json.EndObject();
+      ok = json.EndLine();
+   }
+   return ok;
+}
+
+/**
+ * @brief Reads every logger on every adapter and writes one JSON line per logger to stdout
+ * 
+ * Errors of single adapters or loggers are reported in their JSON object, and do not stop the batch.
+ */
+int JsonBatch(const char* mode)
+{
+   if (strcmp(mode, "array")!=0 && strcmp(mode, "rle")!=0 && strcmp(mode, "lines")!=0) {
+      cerr << "Invalid JSON mode, use array, rle or lines" << endl;
+      return 1;
+   }
+   JsonWriter json(STDOUT_FILENO);
+   int adapters = DS9490::CountUsbDevices();
+   for (int i=0; i<adapters; i++)
+   {
+      DS9490 ds9490;
+      list<uint64_t> serials;
+      if (!ds9490.OpenUsbDevice(i) || !ds9490.Scan1WBus(serials, DS1922::m_familyCode)) {
+         json.BeginObject();
+         json.Key("adapter");
+         json.Int(i);
+         json.Key("error");
+         json.String(ds9490.GetLastError().c_str());
+         json.EndObject();
+         json.EndLine();
+         continue;
+      }
+      for (list<uint64_t>::iterator it=serials.begin(); it!=serials.end(); ++it)
+      {
+         DS1922 ds1922(&ds9490, *it);
+         if (!WriteLoggerJson(json, ds1922, i, mode))
+            break;
+      }
+      // hand each logger to the consumer as soon as it is read
+      if (!json.Flush()) {
+         cerr << json.GetLastError() << endl;
+         return 1;
+      }
+   }
+   if (!json.Flush()) {
+      cerr << json.GetLastError() << endl;
+      return 1;
+   }
+   return 0;
+}
+
+/**
+ * @brief Prints the current temperature of all loggers without mission on all adapters every @p period seconds
+ * 
+ * One JSON line per reading, until the program is terminated.
+ */
+int Live(double period)
+{
+   JsonWriter json(STDOUT_FILENO);
+   LiveMonitor monitor;
+   int adapters = DS9490::CountUsbDevices();
+   vector<DS9490*> ds9490s;
+   for (int i=0; i<adapters; i++)
+   {
+      DS9490* ds9490 = new DS9490;
+      ds9490s.push_back(ds9490);
+      string error;
+      if (!ds9490->OpenUsbDevice(i))
+         error = ds9490->GetLastError();
+      else if (!monitor.AddBus(ds9490, i))
+         error = monitor.GetLastError();
+      else
+         continue;
+      json.BeginObject();
+      json.Key("adapter");
+      json.Int(i);
+      json.Key("error");
+      json.String(error.c_str());
+      json.EndObject();
+      json.EndLine();
+   }
+   int result = 0;
+   if (monitor.GetLoggerCount()==0) {
+      json.Flush();
+      cerr << "No logger without mission found" << endl;
+      result = 1;
+   }
+   timespec next;
+   clock_gettime(CLOCK_MONOTONIC, &next);
+   vector<LiveMonitor::Reading> readings;
+   while (result==0 && monitor.Poll(readings))
+   {
+      for (size_t i=0; i<readings.size(); i++)
+      {
+         json.BeginObject();
+         json.Key("adapter");
+         json.Int(readings[i].adapter);
+         json.Key("rom");
+         json.Hex(readings[i].rom);
+         json.Key("time");
+         json.Double(readings[i].time, 3);
+         if (readings[i].error.code==DeviceError::NONE) {
+            json.Key("temperature");
+            json.Double(readings[i].temperature, 4);
+         } else {
+            json.Key("error");
+            json.String(readings[i].error.ToString().c_str());
+         }
+         json.EndObject();
+         json.EndLine();
+      }
+      if (!json.Flush()) {
+         cerr << json.GetLastError() << endl;
+         result = 1;
+         break;
+      }
+      // keep the rate, unless a round takes longer than the period
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      next.tv_sec += (time_t)period;
+      next.tv_nsec += (long)((period-(time_t)period)*1e9);
+      next.tv_sec += next.tv_nsec/1000000000L;
+      next.tv_nsec %= 1000000000L;
+      if (next.tv_sec<now.tv_sec || (next.tv_sec==now.tv_sec && next.tv_nsec<now.tv_nsec))
+         next = now;
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL)==EINTR)
+         ;
+   }
+   for (size_t i=0; i<ds9490s.size(); i++)
+      delete ds9490s[i];
+   return result;
+}
+
+/**
+ * @brief Starts a new mission on all loggers on all adapters, configured by @p templateText
+ */
+int Provision(const char* templateText)
+{
+   Provisioner::MissionTemplate missionTemplate;
+   string error;
+   if (!Provisioner::ParseTemplate(templateText, missionTemplate, error)) {
+      cerr << error << endl;
+      return 1;
+   }
+   Provisioner provisioner;
+   provisioner.SetResultHandler([](const Provisioner::Result& result) {
+      if (result.ok && result.rtcSkew==result.rtcSkew)
+         printf("%d %016lx ok, clock skew %.3f s\n", result.adapter, result.rom, result.rtcSkew);
+      else if (result.ok)
+         printf("%d %016lx ok\n", result.adapter, result.rom);
+      else
+         printf("%d %016lx failed at %s: %s\n", result.adapter, result.rom, result.step.c_str(),
+                result.error.c_str());
+      fflush(stdout);
+   });
+   vector<Provisioner::Result> results;
+   if (!provisioner.Run(missionTemplate, results)) {
+      cerr << provisioner.GetLastError() << endl;
+      return 1;
+   }
+   int ok = 0;
+   for (size_t i=0; i<results.size(); i++)
+      ok += results[i].ok;
+   printf("%d of %zu loggers prepared\n", ok, results.size());
+   return ok==(int)results.size() ? 0 : 1;
+}
+
+/**
+ * @brief Addresses @p ds1922 by the ROM ID of the first logger found on the bus
+ */
+bool SelectLogger(DS9490& ds9490, DS1922& ds1922)
+{
+   list<uint64_t> serials;
+   if (!ds9490.Scan1WBus(serials, DS1922::m_familyCode)) {
+      cerr << ds9490.GetLastError() << endl;
+      return false;
+   }
+   if (!serials.empty()) {
+      ds1922.SetRom(serials.front());
+      return true;
+   }
+   cerr << "No logger found" << endl;
+   return false;
+}
+
+bool Readout(DS1922& ds1922, bool config, bool data, bool statistics, const char* archive=NULL,
+             const char* storeDirectory=NULL)
+{
+   if (!ds1922.ReadRegister()) {
+      cout << ds1922.GetLastError() << endl;
+      return false;
+   }
+   if (config) {
+      PrintConfig(ds1922);
+   }
+   if (config && (data || statistics))
+      cout << "-Data--------------------------------------------" << endl;
+   
+   // the samples are downloaded once for all outputs. The store alone reads only its new samples.
+   DS1922Snapshot snapshot;
+   if ((data || statistics || archive) && !ds1922.TakeSnapshot(snapshot, true)) {
+      cout << ds1922.GetLastError() << endl;
+      return false;
+   }
+   if ((data || statistics) && !PrintData(snapshot, data, statistics)) {
+      return false;
+   }
+   if (archive) {
+      ArchiveWriter writer;
+      if (!writer.Open(archive) || !writer.Append(snapshot)) {
+         cerr << writer.GetLastError() << endl;
+         return false;
+      }
+   }
+   if (storeDirectory) {
+      MissionStore store;
+      int lost = 0;
+      if (!store.Open(storeDirectory)
+            || !(snapshot.IsValid() ? store.Ingest(snapshot, NULL, &lost) : store.Ingest(ds1922, NULL, &lost))) {
+         cerr << store.GetLastError() << endl;
+         return false;
+      }
+      if (lost>0)
+         cerr << lost << " samples were overwritten since the last readout" << endl;
+   }
+   return true;
+}
+
+/**
+ * @brief Waits for iButtons to be seated and reads each one as soon as it is detected
+ * 
+ * Runs until interrupted.
+ */
+int Watch(DS9490& ds9490, DS1922& ds1922, bool config, bool data, bool statistics, const char* archive,
+          const char* store)
+{
+   PresenceWatcher watcher(&ds9490);
+   cout << "Waiting for iButton..." << endl;
+   while (true) {
+      switch (watcher.Poll()) {
+         case PresenceWatcher::AdapterAttached:
+            cout << "Adapter attached" << endl;
+            break;
+         case PresenceWatcher::AdapterDetached:
+            cout << "Adapter removed" << endl;
+            break;
+         case PresenceWatcher::DeviceArrived: {
+            timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            bool ok = (!(store || archive) || SelectLogger(ds9490, ds1922))
+                      && Readout(ds1922, config, data, statistics, archive, store);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            long ms = (end.tv_sec-start.tv_sec)*1000 + (end.tv_nsec-start.tv_nsec)/1000000;
+            cout << (ok ? "Readout complete" : "Readout failed")
+                 << " (" << ms << " ms)" << endl;
+            break;
+         }
+         case PresenceWatcher::DeviceDeparted:
+            cout << "iButton removed" << endl;
+            break;
+         case PresenceWatcher::NoEvent:
+            break;
+      }
+      usleep(watcher.GetDevicePresent() ? 250000 : 50000);
+   }
+   return 0;
+}
+
 int main(int argc, char **argv) 
 {
    setlocale(LC_ALL,"");
    int optCount = 0;
-   bool scan=false, config=false, data=false;
+   bool scan=false, alarmScan=false, config=false, data=false, statistics=false, watch=false, syncRtc=false;
+   const char* socketPath = NULL;
+   const char* archive = NULL;
+   const char* readArchive = NULL;
+   const char* store = NULL;
+   const char* jsonMode = NULL;
+   const char* missionTemplate = NULL;
+   int scanInterval = 60;
+   double livePeriod = 0;
+   if (argc>1 && strcmp(argv[1], "query")==0) {
+      return Query(argc-1, argv+1);
+   }
    int arg;
-   while ( (arg=getopt(argc, argv, "scd")) !=-1) {
-      optCount++;
+   while ( (arg=getopt(argc, argv, "sAcdtwTD:i:a:r:S:j:P:L:")) !=-1) {
       switch (arg) {
          case 's':
+            optCount++;
             scan = true;
             break;
+         case 'A':
+            optCount++;
+            alarmScan = true;
+            break;
          case 'c':
+            optCount++;
             config = true;
             break;
          case 'd':
+            optCount++;
             data = true;
             break;
+         case 't':
+            optCount++;
+            statistics = true;
+            break;
+         case 'w':
+            watch = true;
+            break;
+         case 'T':
+            optCount++;
+            syncRtc = true;
+            break;
+         case 'D':
+            socketPath = optarg;
+            break;
+         case 'i':
+            scanInterval = atoi(optarg);
+            break;
+         case 'a':
+            optCount++;
+            archive = optarg;
+            break;
+         case 'r':
+            readArchive = optarg;
+            break;
+         case 'S':
+            optCount++;
+            store = optarg;
+            break;
+         case 'j':
+            jsonMode = optarg;
+            break;
+         case 'P':
+            missionTemplate = optarg;
+            break;
+         case 'L':
+            livePeriod = atof(optarg);
+            if (livePeriod<=0)
+               livePeriod = 1;
+            break;
          case '?':
          case 'h':
-            cout << "Usage: ibutton [-s] [-c] [-d]\n"
+            cout << "Usage: ibutton [-s] [-A] [-c] [-d] [-t] [-T] [-a archive] [-S store] [-w] [-D socket [-i interval]]\n"
+                 << "       ibutton -j array|rle|lines\n"
+                 << "       ibutton -P rate=N,unit=s|min,highres=0|1,low=T,high=T,delay=N,rollover=0|1,\n"
+                 << "                  startuponalarm=0|1,rtc=0|1\n"
+                 << "       ibutton -L seconds\n"
+                 << "       ibutton -r archive\n"
+                 << "       ibutton query store [rom [from [to]]]\n"
                  << "  -s: Scan 1W bus\n"
+                 << "  -A: List the loggers in alarm state, using the conditional search\n"
                  << "  -c: Read config\n"
                  << "  -d: Read data\n"
+                 << "  -t: Print statistics of the data\n"
+                 << "  -T: Set the clock to the system time\n"
+                 << "  -a: Append mission to binary archive file\n"
+                 << "  -r: Print missions of binary archive file\n"
+                 << "  -S: Add new samples to store directory\n"
+                 << "  -j: Read all loggers on all adapters, print one JSON line per logger with the samples\n"
+                 << "      as array, run-length encoded, or as separate JSON lines\n"
+                 << "  -P: Stop, clear, configure and start a mission on all loggers on all adapters\n"
+                 << "  -L: Print the current temperature of all loggers without mission on all adapters\n"
+                 << "      every given seconds as JSON lines, using forced conversions\n"
+                 << "  -w: Wait for iButtons and read each one when seated\n"
+                 << "  -D: Run as collector daemon, serving data on Unix socket\n"
+                 << "  -i: Bus scan interval of the daemon in seconds (default: 60)\n"
                  << " (default: -cd)" << endl;
             return 1;
       }
@@ -59,9 +758,29 @@ int main(int argc, char **argv)
       config = data = true;
    }
    
+   if (readArchive) {
+      return PrintArchive(readArchive);
+   }
+   if (jsonMode) {
+      return JsonBatch(jsonMode);
+   }
+   if (missionTemplate) {
+      return Provision(missionTemplate);
+   }
+   if (livePeriod>0) {
+      return Live(livePeriod);
+   }
+   if (socketPath) {
+      return RunDaemon(socketPath, scanInterval>0 ? scanInterval : 60);
+   }
+   
    DS9490 ds9490;
    DS1922 ds1922(&ds9490);
    
+   if (watch) {
+      return Watch(ds9490, ds1922, config, data, statistics, archive, store);
+   }
+   
    if (!ds9490.OpenUsbDevice()) {
       cerr << ds9490.GetLastError() << endl;
       return 1;
@@ -78,70 +797,36 @@ int main(int argc, char **argv)
          }
       }
    }
+   if (alarmScan) {
+      list<uint64_t> serials;
+      if (!ds9490.Scan1WBus(serials, DS1922::m_familyCode, true)) {
+         cerr << ds9490.GetLastError() << endl;
+         return 1;
+      }
+      for (list<uint64_t>::iterator it=serials.begin(); it!=serials.end(); ++it)
+      {
+         printf("Alarm on logger %016lx\n", *it);
+      }
+      if (!syncRtc && !config && !data && !statistics && !archive && !store)
+         return 0;
+   }
 
-   if (!ds1922.ReadRegister()) {
-      cout << ds1922.GetLastError() << endl;
+   if (syncRtc) {
+      double skew;
+      if (!ds1922.ReadRegister() || !ds1922.SyncRtc(&skew)) {
+         cerr << ds1922.GetLastError() << endl;
+         return 1;
+      }
+      printf("Clock synchronized, skew %.3f s\n", skew);
+      if (!config && !data && !statistics && !archive && !store)
+         return 0;
+   }
+   // archive records and the store are keyed by the ROM ID
+   if ((store || archive) && !SelectLogger(ds9490, ds1922)) {
       return 1;
    }
-   if (config) {
-      tm time;
-      ds1922.GetRtc(&time);
-      cout << "Clock enabled: " << ds1922.GetRtcEnabled() << endl;
-      time_t tt = mktime(&time);
-      char buffer[64];
-      strftime(buffer, 64, "%x %X", localtime(&tt));
-      printf("Clock: %s\n", buffer);
-      cout << "Mission in progress: " << ds1922.GetMissionInProgress() << endl;
-      cout << "Sample rate: " << ds1922.GetSampleRate() << endl;
-      cout << "Sample rate high res: " << ds1922.GetHighResLogging() << endl;
-      cout << "Sample count: " << ds1922.GetSampleCount() << endl;
-      cout << "Device sample count: " << ds1922.GetDeviceSampleCount() << endl;
-      cout << "Start upon alarm: " << ds1922.GetStartUponAlarm() << endl;
-      cout << "Alarm activated: low temp: " << ds1922.GetAlarmLow()
-         << ", high temp: " << ds1922.GetAlarmHigh() << endl;
-      cout << "Alarm low temp: " << ds1922.GetAlarmLow()
-         << ", high temp: " << ds1922.GetAlarmHigh() << endl;
-      cout << "Waiting for alarm: " << ds1922.GetWaitingForAlarm() << endl;
-      cout << "Logging enabled: " << ds1922.GetLoggingEnabled() << endl;
-      cout << "Rollover: " << ds1922.GetRollover() << endl;
-      cout << "Mission start delay: " << ds1922.GetMissionStartDelay() << endl;
-      ds1922.GetMissionTimestamp(&time);
-      tt = mktime(&time);
-      strftime(buffer, 64, "%x %X", localtime(&tt));
-      printf("Mission timestamp: %s\n", buffer);
-   }
-   if (config && data)
-      cout << "-Data--------------------------------------------" << endl;
-   
-   if (data) {
-      tm time;
-      ds1922.GetMissionTimestamp(&time);
-      time_t tt = mktime(&time);
-      // handle rollover: the oldest value may not be the first one
-      int missionSamples = ds1922.GetSampleCount();
-      int maxMissionSamples = (ds1922.GetHighResLogging() ? 4096 : 8192);
-      int posOldestValue = missionSamples % maxMissionSamples;
-      int sampleRate = ds1922.GetSampleRate();
-      if (!ds1922.GetHighspeedSampling()) {
-         sampleRate *= 60;
-      }
-      if (missionSamples>maxMissionSamples) {
-         tt += sampleRate*(missionSamples-maxMissionSamples);
-         missionSamples = maxMissionSamples;
-      } else {
-         posOldestValue = 0;
-      }        
-      double values[missionSamples];
-      if (!ds1922.ReadData(values, missionSamples)) {
-         cout << ds1922.GetLastError() << endl;
-      } else {
-         for (int i=0; i<missionSamples; i++) {
-            char buffer[64];
-            strftime(buffer, 64, "%F %X", localtime(&tt));
-            cout << buffer << ": " << values[(i+posOldestValue)%maxMissionSamples] << endl;
-            tt += sampleRate;
-         }
-      }
+   if (!Readout(ds1922, config, data, statistics, archive, store)) {
+      return 1;
    }
    return 0;
 }
@@ -0,0 +1,375 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "collector.h"
+#include "ds1922.h"
+#include "ds9490.h"
+#include "bustopology.h"
+#include "ds1922snapshot.h"
+#include <algorithm>
+#include <string.h>
+
+
+/**
+ * @brief Resumable download of the samples logged since the last readout of one logger
+ * 
+ * The first step reads the register and plans the download, each further step reads one page of the logging
+ * memory. A new mission discards the samples of the previous one. If samples were overwritten since the last
+ * readout, they are counted in lostSamples, and the buffered samples restart with the oldest sample available.
+ */
+class Collector::ReadoutTask : public Task
+{
+public:
+   ReadoutTask(Collector* collector, Logger& logger, time_t now);
+   ~ReadoutTask();
+   bool Step();
+protected:
+   bool Fail();
+   void Finish();
+   
+private:
+   Collector* m_collector;
+   Logger& m_logger;
+   time_t m_now;
+   bool m_planned;
+   MissionMerger::Step m_step;
+   std::vector<uint8_t> m_raw;
+   int m_bytesPerSample;
+   int m_done;             // samples read
+};
+
+
+Collector::Collector()
+{
+   m_scanCount = 0;
+}
+
+Collector::~Collector()
+{
+   m_executor.Clear();
+   for (std::map<uint64_t, Logger>::iterator it=m_loggers.begin(); it!=m_loggers.end(); ++it)
+   {
+      delete it->second.ds1922;
+   }
+   for (size_t i=0; i<m_adapters.size(); i++)
+   {
+      delete m_topologies[i];
+      delete m_adapters[i];
+   }
+}
+
+/**
+ * @brief Searches all adapters for loggers
+ * 
+ * Newly attached adapters are opened, removed ones are deleted. Loggers found for the first time are due for
+ * readout immediately, loggers taken off the bus or with their adapter are dropped once they are not being read out.
+ * The busses are rescanned incrementally from the cached topology, a full search is done every
+ * m_fullScanInterval calls.
+ * @return bool: false if no adapter could be used, the error message is available from GetLastError().
+ */
+bool Collector::Scan()
+{
+   int count = DS9490::CountUsbDevices();
+   if (count!=(int)m_adapters.size()) {
+      // adapters were added or removed, the indices are not stable
+      for (size_t i=0; i<m_adapters.size(); i++)
+      {
+         m_adapters[i]->CloseUsbDevice();
+      }
+      while ((int)m_adapters.size()<count)
+      {
+         m_adapters.push_back(new DS9490);
+         m_topologies.push_back(new BusTopology(m_adapters.back()));
+      }
+      // drop the loggers of removed adapters, a busy one keeps its adapter until the readout has failed
+      int used = count;
+      for (std::map<uint64_t, Logger>::iterator it=m_loggers.begin(); it!=m_loggers.end(); )
+      {
+         Logger& logger = it->second;
+         if (logger.adapter<count) {
+            ++it;
+         } else if (logger.busy) {
+            used = std::max(used, logger.adapter+1);
+            ++it;
+         } else {
+            delete logger.ds1922;
+            it = m_loggers.erase(it);
+         }
+      }
+      while ((int)m_adapters.size()>used)
+      {
+         delete m_topologies.back();
+         m_topologies.pop_back();
+         delete m_adapters.back();
+         m_adapters.pop_back();
+      }
+   }
+   // search all busses now and then, in case a device detect was missed
+   bool full = m_scanCount++ % m_fullScanInterval == 0;
+   bool ok = false;
+   std::vector<bool> scanned(count, false);
+   for (int i=0; i<count; i++)
+   {
+      DS9490* adapter = m_adapters[i];
+      BusTopology* topology = m_topologies[i];
+      if (!adapter->DeviceOpen()) {
+         if (!adapter->OpenUsbDevice(i)) {
+            m_lastError = adapter->GetLastError();
+            continue;
+         }
+         topology->Clear();
+      }
+      std::vector<BusTopology::Event> events;
+      if (!topology->Rescan(events, full)) {
+         m_lastError = topology->GetLastError();
+         adapter->CloseUsbDevice();
+         continue;
+      }
+      ok = true;
+      scanned[i] = true;
+      for (size_t j=0; j<events.size(); j++)
+      {
+         if (!events[j].added)
+            continue;   // removals are handled below, once all busses are scanned
+         uint64_t rom = events[j].rom;
+         std::map<uint64_t, Logger>::iterator found = m_loggers.find(rom);
+         if (found!=m_loggers.end()) {
+            if (found->second.adapter==i)
+               continue;
+            if (found->second.busy) {
+               // move it after the readout, when the bus is searched again
+               topology->Clear();
+               continue;
+            }
+            // moved to another adapter
+            delete found->second.ds1922;
+            found->second.ds1922 = new DS1922(adapter, rom);
+            found->second.ds1922->SetPriority(BusArbiter::Background);
+            found->second.adapter = i;
+            continue;
+         }
+         Logger logger;
+         logger.rom = rom;
+         logger.ds1922 = new DS1922(adapter, rom);
+         logger.ds1922->SetPriority(BusArbiter::Background);
+         logger.adapter = i;
+         logger.missionTimestamp = 0;
+         logger.interval = 0;
+         logger.firstSample = 0;
+         logger.lostSamples = 0;
+         logger.lastReadout = 0;
+         logger.nextReadout = 0;
+         logger.busy = false;
+         m_loggers[rom] = logger;
+      }
+   }
+   // drop the loggers taken off the bus, unless they moved to another adapter or are being read out
+   for (std::map<uint64_t, Logger>::iterator it=m_loggers.begin(); it!=m_loggers.end(); )
+   {
+      Logger& logger = it->second;
+      if (logger.busy || !scanned[logger.adapter]
+            || m_topologies[logger.adapter]->Contains(it->first)) {
+         ++it;
+         continue;
+      }
+      delete logger.ds1922;
+      it = m_loggers.erase(it);
+   }
+   if (count==0)
+      m_lastError = "No DS2490 found";
+   return ok;
+}
+
+/**
+ * @brief Starts the readout of all loggers whose readout is due at @p now
+ * 
+ * The readouts are carried out by Step().
+ */
+void Collector::ReadDue(time_t now)
+{
+   for (std::map<uint64_t, Logger>::iterator it=m_loggers.begin(); it!=m_loggers.end(); ++it)
+   {
+      if (!it->second.busy && it->second.nextReadout<=now) {
+         m_executor.Post(new ReadoutTask(this, it->second, now));
+      }
+   }
+}
+
+/**
+ * @brief Advances every running readout by one memory page
+ * 
+ * Call this from the event loop while IsBusy() returns true. Readouts on different adapters proceed
+ * in turn, so none of them blocks the others for the whole download.
+ * @return bool: true if readouts are still running.
+ */
+bool Collector::Step()
+{
+   return m_executor.RunOnce();
+}
+
+/**
+ * @brief Returns the earliest time a readout is due, or 0 if no logger is waiting for its readout
+ */
+time_t Collector::GetNextDue()
+{
+   time_t next = 0;
+   for (std::map<uint64_t, Logger>::iterator it=m_loggers.begin(); it!=m_loggers.end(); ++it)
+   {
+      if (it->second.busy)
+         continue;
+      if (next==0 || it->second.nextReadout<next)
+         next = it->second.nextReadout;
+   }
+   return next;
+}
+
+Collector::ReadoutTask::ReadoutTask(Collector* collector, Logger& logger, time_t now)
+   : m_logger(logger)
+{
+   m_collector = collector;
+   m_now = now;
+   m_planned = false;
+   m_bytesPerSample = 1;
+   m_done = 0;
+   m_logger.busy = true;
+}
+
+Collector::ReadoutTask::~ReadoutTask()
+{
+   m_logger.busy = false;
+}
+
+bool Collector::ReadoutTask::Step()
+{
+   DS1922* ds1922 = m_logger.ds1922;
+   if (!m_planned) {
+      if (!m_collector->m_adapters[m_logger.adapter]->DeviceOpen()) {
+         m_logger.lastError = DeviceError(DeviceError::NOT_OPEN);
+         m_logger.nextReadout = m_now + m_minPeriod;
+         return false;
+      }
+      if (!ds1922->ReadRegister())
+         return Fail();
+      m_step = m_logger.merger.Plan(MissionMerger::TakeSnapshot(*ds1922));
+      m_bytesPerSample = ds1922->GetHighResLogging() ? 2 : 1;
+      m_raw.resize(m_step.count*m_bytesPerSample);
+      m_planned = true;
+      return true;
+   }
+   if (m_done<m_step.count) {
+      // read up to the end of the page holding the next sample
+      int samplesPerPage = 32/m_bytesPerSample;
+      int position = (m_step.first+m_done) % ds1922->GetLogCapacity();
+      int count = std::min(samplesPerPage - position%samplesPerPage, m_step.count-m_done);
+      if (!ds1922->ReadRawSamples(&m_raw[m_done*m_bytesPerSample], m_step.first+m_done, count))
+         return Fail();
+      m_done += count;
+      if (m_done<m_step.count)
+         return true;
+   }
+   Finish();
+   return false;
+}
+
+bool Collector::ReadoutTask::Fail()
+{
+   m_logger.lastError = m_logger.ds1922->GetError();
+   m_collector->Retry(m_logger, m_now);
+   return false;
+}
+
+/**
+ * @brief Converts the downloaded samples and adds them to the buffer of the logger
+ */
+void Collector::ReadoutTask::Finish()
+{
+   DS1922* ds1922 = m_logger.ds1922;
+   std::vector<double> buffer(m_step.count);
+   double calibration[3];
+   bool calibrated = m_step.count>0 && ds1922->GetCalibration(calibration);
+   DS1922Decoder::GetLogConverter(ds1922->GetType(), m_bytesPerSample==2, calibrated)(m_raw.data(), m_step.count,
+      calibration, buffer.data());
+   
+   Logger& logger = m_logger;
+   logger.merger.Commit(m_step);
+   if (m_step.newMission) {
+      logger.missionTimestamp = m_step.snapshot.missionStart;
+      logger.interval = m_step.snapshot.interval;
+      logger.samples.clear();
+      logger.firstSample = m_step.first;
+      logger.lostSamples = 0;
+   } else if (m_step.lost.count>0) {
+      logger.lostSamples += m_step.lost.count;
+      logger.samples.clear();
+      logger.firstSample = m_step.first;
+   }
+   logger.samples.insert(logger.samples.end(), buffer.begin(), buffer.end());
+   if ((int)logger.samples.size()>m_maxBufferedSamples) {
+      int drop = logger.samples.size() - m_maxBufferedSamples;
+      logger.samples.erase(logger.samples.begin(), logger.samples.begin()+drop);
+      logger.firstSample += drop;
+   }
+   logger.lastError.Clear();
+   logger.lastReadout = m_now;
+   m_collector->Schedule(logger, m_now);
+}
+
+/**
+ * @brief Schedules the next attempt after a failed readout, depending on the cause in logger.lastError
+ * 
+ * Bus errors like a wrong CRC are usually transient, so the readout is retried after m_retryPeriod. After a USB
+ * error the adapter is closed, so the next Scan() opens it again. Otherwise, e.g. if the logger was removed,
+ * the readout is retried after m_minPeriod.
+ */
+void Collector::Retry(Logger& logger, time_t now)
+{
+   if (logger.lastError.IsBusError()) {
+      logger.nextReadout = now + m_retryPeriod;
+      return;
+   }
+   if (logger.lastError.IsUsbError())
+      m_adapters[logger.adapter]->CloseUsbDevice();
+   logger.nextReadout = now + m_minPeriod;
+}
+
+/**
+ * @brief Sets the time of the next readout
+ * 
+ * With rollover, the logger is read after half the time it takes to fill the whole logging memory, otherwise
+ * when the memory is full and logging stops. 
+ */
+void Collector::Schedule(Logger& logger, time_t now)
+{
+   DS1922* ds1922 = logger.ds1922;
+   int remaining = ds1922->GetLogCapacity();
+   if (ds1922->GetRollover()) {
+      remaining /= 2;
+   } else {
+      remaining -= ds1922->GetSampleCount();
+   }
+   long period = m_maxPeriod;
+   if (ds1922->GetMissionInProgress() && remaining>0) {
+      period = (long)remaining*logger.interval;
+   }
+   if (period<m_minPeriod)
+      period = m_minPeriod;
+   if (period>m_maxPeriod)
+      period = m_maxPeriod;
+   logger.nextReadout = now + period;
+}
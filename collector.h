@@ -0,0 +1,98 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <cstdint>
+
+#include "missionmerger.h"
+#include "deviceerror.h"
+#include "executor.h"
+
+class DS9490;
+class DS1922;
+class BusTopology;
+
+/**
+ * @brief Collects the data of all DS1922 loggers on all attached DS9490 adapters
+ * 
+ * The adapters are kept open. Scan() searches all 1-Wire busses for loggers, ReadDue() downloads the new samples
+ * of every logger whose readout is due. The readout of each logger is scheduled from its sample rate and the
+ * remaining logging memory, so that it is read before rollover overwrites samples not downloaded yet.
+ * Only the samples logged since the last readout are downloaded.
+ * Readouts run as tasks of a single-threaded Executor, one memory page per Step(), so the downloads of all
+ * loggers share the calling thread and can be interleaved with other work of its event loop.
+ */
+class Collector
+{
+public:
+   Collector();
+   ~Collector();
+   
+public:
+   struct Logger
+   {
+      uint64_t rom;
+      DS1922* ds1922;
+      int adapter;
+      time_t missionTimestamp;   // identifies the mission
+      int interval;              // seconds between samples
+      int firstSample;           // mission sample number of samples[0]
+      std::vector<double> samples;
+      int lostSamples;           // overwritten before they could be read
+      MissionMerger merger;
+      time_t lastReadout;
+      time_t nextReadout;
+      DeviceError lastError;
+      bool busy;                 // readout in progress
+   };
+   
+   std::string GetLastError() {return m_lastError;}
+   bool Scan();
+   void ReadDue(time_t now);
+   bool Step();
+   bool IsBusy() {return !m_executor.IsIdle();}
+   time_t GetNextDue();
+   const std::map<uint64_t, Logger>& GetLoggers() {return m_loggers;}
+   
+   static const int m_minPeriod = 60;        // seconds between readouts of a logger
+   static const int m_retryPeriod = 5;       // seconds before retrying after a bus error
+   static const int m_maxPeriod = 24*3600;   // "
+   static const int m_maxBufferedSamples = 65536;
+   static const int m_fullScanInterval = 10; // every n-th Scan() searches all busses
+protected:
+   class ReadoutTask;
+   void Schedule(Logger& logger, time_t now);
+   void Retry(Logger& logger, time_t now);
+   
+   // Data
+private:
+   std::string m_lastError;
+   std::vector<DS9490*> m_adapters;
+   std::vector<BusTopology*> m_topologies;   // one per adapter
+   int m_scanCount;
+   std::map<uint64_t, Logger> m_loggers;
+   Executor m_executor;
+};
+
+#endif // COLLECTOR_H
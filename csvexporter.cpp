@@ -0,0 +1,149 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "csvexporter.h"
+#include <charconv>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+
+/**
+ * @brief Constructor for writing to the file descriptor @p fd
+ * 
+ * The file descriptor is not closed by this class.
+ */
+CsvExporter::CsvExporter(int fd, const char* separator)
+{
+   m_fd = fd;
+   m_output = NULL;
+   m_separator = separator;
+   m_time = 0;
+   m_minute = 0;
+   m_second = 0;
+   m_used = 0;
+}
+
+/**
+ * @brief Constructor for appending to @p output
+ */
+CsvExporter::CsvExporter(std::string* output, const char* separator)
+{
+   m_fd = -1;
+   m_output = output;
+   m_separator = separator;
+   m_time = 0;
+   m_minute = 0;
+   m_second = 0;
+   m_used = 0;
+}
+
+CsvExporter::~CsvExporter()
+{
+   Flush();
+}
+
+/**
+ * @brief Writes @p count values, the first one taken at @p start, with @p interval seconds between them
+ */
+bool CsvExporter::Write(const double* values, int count, time_t start, int interval)
+{
+   // timestamp, separator, value, newline
+   const int maxLine = 19 + m_separator.size() + 32 + 1;
+   if ((int)sizeof(m_buffer)<maxLine) {
+      m_lastError = "Separator too long";
+      return false;
+   }
+   FormatTime(start);
+   for (int i=0; i<count; i++)
+   {
+      if (i>0)
+         StepTime(interval);
+      if (m_used+maxLine>(int)sizeof(m_buffer) && !Flush())
+         return false;
+      char* p = m_buffer+m_used;
+      memcpy(p, m_timeText, 19);
+      p += 19;
+      memcpy(p, m_separator.data(), m_separator.size());
+      p += m_separator.size();
+      // same digits as the default of std::ostream
+      p = std::to_chars(p, m_buffer+sizeof(m_buffer), values[i], std::chars_format::general, 6).ptr;
+      *p++ = '\n';
+      m_used = p-m_buffer;
+   }
+   return true;
+}
+
+/**
+ * @brief Writes the buffered output
+ */
+bool CsvExporter::Flush()
+{
+   if (m_output) {
+      m_output->append(m_buffer, m_used);
+      m_used = 0;
+      return true;
+   }
+   int written = 0;
+   while (written<m_used) {
+      ssize_t result = write(m_fd, m_buffer+written, m_used-written);
+      if (result<0) {
+         if (errno==EINTR)
+            continue;
+         m_lastError = strerror(errno);
+         m_used = 0;
+         return false;
+      }
+      written += result;
+   }
+   m_used = 0;
+   return true;
+}
+
+void CsvExporter::FormatTime(time_t time)
+{
+   tm local;
+   localtime_r(&time, &local);
+   char buffer[64];
+   strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &local);
+   memcpy(m_timeText, buffer, 19);
+   m_timeText[19] = 0;
+   m_time = time;
+   m_minute = local.tm_min;
+   m_second = local.tm_sec;
+}
+
+/**
+ * @brief Advances the formatted timestamp by @p interval seconds
+ */
+void CsvExporter::StepTime(int interval)
+{
+   int seconds = m_minute*60 + m_second + interval;
+   if (interval<0 || seconds>=3600) {
+      FormatTime(m_time+interval);
+      return;
+   }
+   m_time += interval;
+   m_minute = seconds/60;
+   m_second = seconds%60;
+   m_timeText[14] = '0' + m_minute/10;
+   m_timeText[15] = '0' + m_minute%10;
+   m_timeText[17] = '0' + m_second/10;
+   m_timeText[18] = '0' + m_second%10;
+}
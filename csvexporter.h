@@ -0,0 +1,64 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CSVEXPORTER_H
+#define CSVEXPORTER_H
+
+#include <string>
+#include <ctime>
+
+/**
+ * @brief Writes time series as text, one line with timestamp and value per sample
+ * 
+ * The output is buffered and written to a file descriptor or appended to a string. Timestamps are local time
+ * in the format "YYYY-MM-DD HH:MM:SS". When stepping from one sample to the next within the same hour, only
+ * the minute and second digits are updated; the full local time conversion is only done at hour boundaries,
+ * where daylight saving time can change. Values are formatted with std::to_chars.
+ * Functions that write return false on error, the error message is available from GetLastError().
+ */
+class CsvExporter
+{
+public:
+   CsvExporter(int fd, const char* separator="\t");
+   CsvExporter(std::string* output, const char* separator="\t");
+   ~CsvExporter();
+   
+public:
+   std::string GetLastError() {return m_lastError;}
+   bool Write(const double* values, int count, time_t start, int interval);
+   bool Flush();
+   
+protected:
+   void FormatTime(time_t time);
+   void StepTime(int interval);
+   
+   // Data
+private:
+   std::string m_lastError;
+   int m_fd;
+   std::string* m_output;
+   std::string m_separator;
+   time_t m_time;
+   int m_minute;
+   int m_second;
+   char m_timeText[20];    // "YYYY-MM-DD HH:MM:SS"
+   int m_used;
+   char m_buffer[65536];
+};
+
+#endif // CSVEXPORTER_H
@@ -0,0 +1,74 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "deviceerror.h"
+#include <stdio.h>
+
+
+/**
+ * @brief Returns the static message for the error code
+ */
+const char* DeviceError::GetMessage() const
+{
+   switch (code)
+   {
+   case NONE:                  return "No error";
+   case NO_ADAPTER:            return "No DS2490 found";
+   case USB_OPEN:              return "Failed to open USB device";
+   case USB_CONFIGURATION:     return "Failed to set configuration";
+   case USB_INTERFACE:         return "Failed to claim interface";
+   case USB_ALTINTERFACE:      return "Failed to set altinterface";
+   case NOT_OPEN:              return "Device not open";
+   case USB_COMMAND:           return "Error writing USB command";
+   case USB_STATUS:            return "Error reading device status";
+   case USB_DATA:              return "Error reading data";
+   case ECHO_MISMATCH:         return "WriteByte: read data != written data";
+   case NO_PRESENCE:           return "No device present";
+   case SHORTED:               return "1-Wire bus shorted";
+   case CRC:                   return "Wrong CRC reading data";
+   case SCRATCHPAD_ADDRESS:    return "read Scratchpad target address wrong";
+   case SCRATCHPAD_DATA:       return "read Scratchpad data wrong";
+   case COPY_TIMEOUT:          return "copy Scratchpad: no completion";
+   case COPY_FAILED:           return "copy Scratchpad: AA bit not 1";
+   case NO_REGISTER:           return "Read register first";
+   case MISSION_IN_PROGRESS:   return "Clock cannot be set during a mission";
+   case RTC_DISABLED:          return "Clock oscillator not enabled";
+   case ADAPTER_TOO_SLOW:      return "Adapter too slow to set the clock";
+   case RTC_STOPPED:           return "Clock not running";
+   case SAMPLES_NOT_AVAILABLE: return "Samples not available";
+   case CANCELLED:             return "Cancelled";
+   }
+   return "Unknown error";
+}
+
+/**
+ * @brief Formats the message with the details that are known
+ */
+std::string DeviceError::ToString() const
+{
+   char buffer[160];
+   int length = snprintf(buffer, sizeof(buffer), "%s", GetMessage());
+   if (usbResult!=0)
+      length += snprintf(buffer+length, sizeof(buffer)-length, " (USB %d)", usbResult);
+   if (status>=0)
+      length += snprintf(buffer+length, sizeof(buffer)-length, ", status 0x%02X", status);
+   if (address>=0)
+      length += snprintf(buffer+length, sizeof(buffer)-length, ", page 0x%04X", address);
+   return buffer;
+}
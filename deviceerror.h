@@ -0,0 +1,56 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DEVICEERROR_H
+#define DEVICEERROR_H
+#include <string>
+#include <cerrno>
+
+/**
+ * @brief Cause of the last failure of a DS9490 or DS1922 operation
+ * 
+ * A plain value without heap memory, so setting it on every failure of a retry loop costs nothing. Besides the
+ * code, it holds the return value of the failing libusb call, the DS2490 result or device status byte, and the
+ * memory page address involved, each if known. The message is only formatted when ToString() is called.
+ */
+struct DeviceError
+{
+   enum Code {NONE, NO_ADAPTER, USB_OPEN, USB_CONFIGURATION, USB_INTERFACE, USB_ALTINTERFACE, NOT_OPEN,
+      USB_COMMAND, USB_STATUS, USB_DATA, ECHO_MISMATCH, NO_PRESENCE, SHORTED, CRC, SCRATCHPAD_ADDRESS, SCRATCHPAD_DATA,
+      COPY_TIMEOUT, COPY_FAILED, NO_REGISTER, MISSION_IN_PROGRESS, RTC_DISABLED, ADAPTER_TOO_SLOW, RTC_STOPPED,
+      SAMPLES_NOT_AVAILABLE, CANCELLED};
+   
+   DeviceError() {Clear();}
+   DeviceError(Code code, int usbResult=0, int status=-1, int address=-1)
+      : code(code), usbResult(usbResult), status(status), address(address) {}
+   void Clear() {code = NONE; usbResult = 0; status = -1; address = -1;}
+   bool IsUsbError() const {return code>=USB_COMMAND && code<=USB_DATA;}
+   bool IsTimeout() const {return usbResult==-ETIMEDOUT;}
+   bool IsBusError() const {return code==ECHO_MISMATCH || code==CRC || code==SCRATCHPAD_ADDRESS
+      || code==SCRATCHPAD_DATA;}
+   const char* GetMessage() const;
+   std::string ToString() const;
+   
+   Code code;
+   int usbResult;    // return value of the failing libusb call, 0 if none
+   int status;       // DS2490 result or device status byte, -1 if none
+   int address;      // memory page address, -1 if none
+};
+
+#endif // DEVICEERROR_H
@@ -19,21 +19,30 @@
 
 #include "ds1922.h"
 #include "ds9490.h"
+#include "ds1922snapshot.h"
 #include <string.h>
+#include <errno.h>
 #include <ctime>
+#include <vector>
+#include <algorithm>
+#include <limits>
 
 
 /**
  * @brief Constructor
  * 
  * @param DS9490* ds9490: Pointer to an instance of class DS9490, which needs to have a lifetime longer than this object.
+ * @param uint64_t rom: ROM ID of the device on the 1-Wire bus. With 0, the device is not addressed, which only works
+ * with a single device on the bus.
  */
-DS1922::DS1922(DS9490* ds9490)
+DS1922::DS1922(DS9490* ds9490, uint64_t rom)
 {
    m_ds9490 = ds9490;
+   m_rom = rom;
+   m_priority = BusArbiter::Normal;
    m_statusRegisterValid = false;
    m_calibrationValid = false;
-   m_rtcChanged = false;
+   ClearDirty();
 }
 
 DS1922::~DS1922()
@@ -52,7 +61,7 @@ bool DS1922::ReadRegister()
 {
    if (!m_ds9490->DeviceOpen())
       if (!m_ds9490->OpenUsbDevice()) {
-         m_lastError = m_ds9490->GetLastError();
+         m_error = m_ds9490->GetError();
          return false;
       }
 
@@ -60,7 +69,8 @@ bool DS1922::ReadRegister()
          && ReadMemPage(0x0220, m_statusRegister+32))
    {
       m_statusRegisterValid = true;
-      m_rtcChanged = false;
+      ClearDirty();
+      m_calibrationValid = false;   // might be another device by now
       return true;
    }
       
@@ -72,129 +82,290 @@ bool DS1922::ReadRegister()
  * 
  * After setting all configuration registers using the Set...() function of this class,
  * this function can be used to write these settings to the device.
+ * Only the bytes changed since ReadRegister() are written, as one range per page, and a page without
+ * changes is skipped. Nothing is written if no setting changed.
  * @return bool: true on success, false on error.
  */
 bool DS1922::WriteRegister()
 {
    if (!m_statusRegisterValid) {
-      m_lastError = "no valid data to write";
+      m_error = DeviceError(DeviceError::NO_REGISTER);
       return false;
    }
-   // 1st page: write complete if clock was changed, if not,
-   // skip first 6 bytes
-   // procedure: 1. write data to scratchpad, 
-   //            2. verify scratchpad, 
-   //            3. copy scratchpad to target address
+   for (int page=0; page<2; page++)
+   {
+      int begin = m_dirtyBegin[page];
+      int end = m_dirtyEnd[page];
+      if (begin>=end)
+         continue;
+      if (!WritePage(0x0200 + page*32 + begin, m_statusRegister + page*32 + begin, end-begin))
+         return false;
+      m_dirtyBegin[page] = 32;
+      m_dirtyEnd[page] = 0;
+   }
+   return true;
+}
+
+/**
+ * @brief Marks the register bytes from @p offset to @p offset + @p length as changed
+ * 
+ * The range must not cross a page boundary. The changed ranges of a page are merged into one.
+ */
+void DS1922::MarkDirty(int offset, int length)
+{
+   int page = offset/32;
+   m_dirtyBegin[page] = std::min(m_dirtyBegin[page], offset%32);
+   m_dirtyEnd[page] = std::max(m_dirtyEnd[page], offset%32 + length);
+}
+
+void DS1922::ClearDirty()
+{
+   for (int page=0; page<2; page++)
+   {
+      m_dirtyBegin[page] = 32;
+      m_dirtyEnd[page] = 0;
+   }
+}
+
+/**
+ * @brief Sets the register byte at @p offset, and marks it as changed if its value differs
+ */
+void DS1922::SetRegister(int offset, uint8_t value)
+{
+   if (m_statusRegister[offset]==value)
+      return;
+   m_statusRegister[offset] = value;
+   MarkDirty(offset, 1);
+}
+
+/**
+ * @brief Sets or clears the bits of @p mask in the register byte at @p offset
+ */
+void DS1922::SetRegisterBits(int offset, uint8_t mask, bool set)
+{
+   SetRegister(offset, set ? m_statusRegister[offset]|mask : m_statusRegister[offset]&~mask);
+}
+
+/**
+ * @brief Writes @p length bytes to the memory starting at @p address
+ * 
+ * The data must not cross a page boundary. The page is written as one transaction on the bus.
+ * Procedure: 1. write data to scratchpad, 
+ *            2. verify scratchpad, 
+ *            3. copy scratchpad to target address
+ */
+bool DS1922::WritePage(uint16_t address, const uint8_t* data, int length)
+{
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
+   uint8_t verification[3];
+   return WriteScratchpad(address, data, length, verification) && CopyScratchpad(verification);
+}
+
+/**
+ * @brief Writes @p length bytes for @p address to the scratchpad, and verifies them
+ * 
+ * @param uint8_t* verification: receives the target address and E/S byte read back, needed by CopyScratchpad()
+ */
+bool DS1922::WriteScratchpad(uint16_t address, const uint8_t* data, int length, uint8_t* verification)
+{
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
    uint8_t command[32+3] = {0x0F, // write scratchpad
-      (uint8_t)(m_rtcChanged ? 0x00 : 0x06), 0x02, // address
+      (uint8_t)(address&0xFF), (uint8_t)((address&0xFF00)>>8),
    };
-   if (m_rtcChanged) {
-      memcpy(command+3, m_statusRegister, 32);
-   } else {
-      memcpy(command+3, m_statusRegister+6, 32-6);
-   }
-   if (!m_ds9490->Write1W(command, 3+32-(m_rtcChanged?0:6))) {
-      m_lastError = m_ds9490->GetLastError();
+   memcpy(command+3, data, length);
+   if (!m_ds9490->Write1W(command, 3+length, m_rom)) {
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
    // read scratchpad to verify
    uint8_t readspcommand[] = {0xAA}; // read scratchpad
-   if (!m_ds9490->Write1W(readspcommand, 1)) {
-      m_lastError = m_ds9490->GetLastError();
+   if (!m_ds9490->Write1W(readspcommand, 1, m_rom)) {
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
    uint8_t scratchpad[3+32];
    if (!m_ds9490->Read1W(scratchpad, 3+32)) {
-      m_lastError = m_ds9490->GetLastError();
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
    // verify:
    if (scratchpad[0]!=command[1] || scratchpad[1]!=command[2]) {
-      m_lastError = "read Scratchpad target address wrong";
+      m_error = DeviceError(DeviceError::SCRATCHPAD_ADDRESS, 0, -1, address);
       return false;
    }
-   for (int i=0; i<(m_rtcChanged?32:(32-6)); i++) {
+   for (int i=0; i<length; i++) {
       if (scratchpad[i+3]!=command[i+3]) {
-         m_lastError = "read Scratchpad data wrong";
+         m_error = DeviceError(DeviceError::SCRATCHPAD_DATA, 0, -1, address);
          return false;
       }
    }
-   // copy scratchpad 
+   memcpy(verification, scratchpad, 3);
+   return true;
+}
+
+/**
+ * @brief Copies the scratchpad to memory, and checks the result
+ * 
+ * @param const uint8_t* verification: target address and E/S byte, see WriteScratchpad()
+ */
+bool DS1922::CopyScratchpad(const uint8_t* verification)
+{
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
+   uint16_t address = verification[0] | verification[1]<<8;
    uint8_t copycommand[] = {0x99,  // copy scratchpad
-      scratchpad[0], scratchpad[1], scratchpad[2], // verification code
+      verification[0], verification[1], verification[2], // verification code
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // dummy password (TODO: password)
    };
-   if (!m_ds9490->Write1W(copycommand, sizeof(copycommand))) {
-      m_lastError = m_ds9490->GetLastError();
+   if (!m_ds9490->Write1W(copycommand, sizeof(copycommand), m_rom)) {
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
-   sleep(1);
+   // the device answers with alternating 0 and 1 bits once the copy is done, which takes some µs
+   timespec start, now;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   while (true) {
+      uint8_t status;
+      if (!m_ds9490->Read1W(&status, 1)) {
+         m_error = m_ds9490->GetError();
+      m_error.address = address;
+         return false;
+      }
+      if (status==0xAA || status==0x55)
+         break;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if ((now.tv_sec-start.tv_sec)*1000 + (now.tv_nsec-start.tv_nsec)/1000000 > m_copyTimeout) {
+         m_error = DeviceError(DeviceError::COPY_TIMEOUT, 0, status, address);
+         return false;
+      }
+   }
    // check AA bit
-   if (!m_ds9490->Write1W(readspcommand, 1)) {
-      m_lastError = m_ds9490->GetLastError();
+   uint8_t readspcommand[] = {0xAA}; // read scratchpad
+   uint8_t scratchpad[3+32];
+   if (!m_ds9490->Write1W(readspcommand, 1, m_rom)) {
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
    if (!m_ds9490->Read1W(scratchpad, 3+32)) {
-      m_lastError = m_ds9490->GetLastError();
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
    if (!(scratchpad[2]&0x80)) {
-      m_lastError = "copy Scratchpad: AA bit not 1";
+      m_error = DeviceError(DeviceError::COPY_FAILED, 0, scratchpad[2], address);
       return false;
    }
-   
-   // 2nd page
-   // write scratchpad
-   command[1] = 0x20;   // address
-   command[2] = 0x02;   // "
-   memcpy(command+3, m_statusRegister+32, 32);
-   if (!m_ds9490->Write1W(command, 3+32)) {
-      m_lastError = m_ds9490->GetLastError();
+   return true;
+}
+
+static double Now()
+{
+   timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   return now.tv_sec + now.tv_nsec/1e9;
+}
+
+/**
+ * @brief Sets the clock to the system time, compensating the latency of the adapter
+ * 
+ * The duration of bus commands through the adapter is measured first. The time of an upcoming full second
+ * is written to the scratchpad in advance, and the Copy Scratchpad command, which makes it effective, is sent
+ * so that it completes at that second. Then the clock is read until its seconds change, to measure the remaining
+ * skew. The bus is held during the whole procedure, at most about 3 seconds.
+ * ReadRegister() has to be called before, and no mission may be in progress.
+ * @param double* skew: if not NULL, receives the offset of the device clock from the system clock in seconds,
+ * accurate to about half the duration of a page read.
+ */
+bool DS1922::SyncRtc(double* skew)
+{
+   if (!m_statusRegisterValid) {
+      m_error = DeviceError(DeviceError::NO_REGISTER);
       return false;
    }
-   // read scratchpad to verify
-   if (!m_ds9490->Write1W(readspcommand, 1)) {
-      m_lastError = m_ds9490->GetLastError();
+   if (GetMissionInProgress()) {
+      m_error = DeviceError(DeviceError::MISSION_IN_PROGRESS);
       return false;
    }
-   if (!m_ds9490->Read1W(scratchpad, 3+32)) {
-      m_lastError = m_ds9490->GetLastError();
+   if (!GetRtcEnabled()) {
+      m_error = DeviceError(DeviceError::RTC_DISABLED);
       return false;
    }
-   // verify:
-   if (scratchpad[0]!=command[1] || scratchpad[1]!=command[2]) {
-      m_lastError = "read Scratchpad target address wrong";
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
+   
+   // measure the time per byte through the adapter with a harmless command, counting the reset as a byte
+   uint8_t command[3+6] = {0x0F, 0x00, 0x02};   // write scratchpad for the clock
+   memcpy(command+3, m_statusRegister, 6);
+   int romBytes = m_rom ? 9 : 1;
+   double start = Now();
+   if (!m_ds9490->Write1W(command, sizeof(command), m_rom)) {
+      m_error = m_ds9490->GetError();
       return false;
    }
-   for (int i=0; i<32; i++) {
-      if (scratchpad[i+3]!=command[i+3]) {
-         m_lastError = "read Scratchpad data wrong";
+   double byteTime = (Now()-start) / (1+romBytes+sizeof(command));
+   // reset, ROM and copy scratchpad command with verification code and password
+   double copyLatency = byteTime * (1+romBytes+12);
+   
+   uint8_t verification[3];
+   time_t target = 0;
+   for (int attempt=0; ; attempt++)
+   {
+      // leave time for writing and verifying the scratchpad, which takes about 6 times as many bytes
+      target = (time_t)(Now() + copyLatency + 100*byteTime) + 1;
+      tm local;
+      localtime_r(&target, &local);
+      SetRtc(&local);
+      if (!WriteScratchpad(0x0200, m_statusRegister, 6, verification))
+         return false;
+      if (Now()<target-copyLatency)
+         break;
+      if (attempt==2) {
+         m_error = DeviceError(DeviceError::ADAPTER_TOO_SLOW);
          return false;
       }
    }
-   // copy scratchpad 
-   copycommand[1] = scratchpad[0];  // verification code
-   copycommand[2] = scratchpad[1];  // "
-   copycommand[3] = scratchpad[2];  // "
-   if (!m_ds9490->Write1W(copycommand, sizeof(copycommand))) {
-      m_lastError = m_ds9490->GetLastError();
-      return false;
-   }
-   sleep(1);
-   // check AA bit
-   if (!m_ds9490->Write1W(readspcommand, 1)) {
-      m_lastError = m_ds9490->GetLastError();
+   double copyTime = target - copyLatency;
+   timespec wakeup;
+   wakeup.tv_sec = (time_t)copyTime;
+   wakeup.tv_nsec = (copyTime - wakeup.tv_sec) * 1e9;
+   while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &wakeup, NULL)==EINTR)
+      ;
+   if (!CopyScratchpad(verification))
       return false;
-   }
-   if (!m_ds9490->Read1W(scratchpad, 3+32)) {
-      m_lastError = m_ds9490->GetLastError();
-      return false;
-   }
-   if (!(scratchpad[2]&0x80)) {
-      m_lastError = "copy Scratchpad: AA bit not 1";
-      return false;
-   }   
+   // the clock is written, other pending changes of the page are not
+   m_dirtyBegin[0] = std::max(m_dirtyBegin[0], 6);
    
+   if (skew) {
+      // the seconds change between two reads, the time of a read is taken as the middle of it
+      uint8_t page[32];
+      double before = Now();
+      if (!ReadMemPage(0x0200, page))
+         return false;
+      double previous = (before+Now())/2;
+      double current;
+      uint8_t seconds = page[0];
+      while (true) {
+         before = Now();
+         if (!ReadMemPage(0x0200, page))
+            return false;
+         current = (before+Now())/2;
+         if (page[0]!=seconds)
+            break;
+         if (current-target>2.5) {
+            m_error = DeviceError(DeviceError::RTC_STOPPED);
+            return false;
+         }
+         previous = current;
+      }
+      memcpy(m_statusRegister, page, 6);
+      tm deviceTime;
+      GetRtc(&deviceTime);
+      deviceTime.tm_isdst = -1;
+      *skew = mktime(&deviceTime) - (previous+current)/2;
+   }
    return true;
 }
 
@@ -205,12 +376,13 @@ bool DS1922::WriteRegister()
  */
 bool DS1922::StartMission()
 {
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
    uint8_t command[] = {0xCC, // start mission
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // dummy password (TODO: password)
       0xFF  // dummy byte
    };
-   if (!m_ds9490->Write1W(command, sizeof(command))) {
-      m_lastError = m_ds9490->GetLastError();
+   if (!m_ds9490->Write1W(command, sizeof(command), m_rom)) {
+      m_error = m_ds9490->GetError();
       return false;
    }
    return true;
@@ -221,30 +393,104 @@ bool DS1922::StartMission()
  */
 bool DS1922::StopMission()
 {
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
    uint8_t command[] = {0x33, // stop mission
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // dummy password (TODO: password)
       0xFF  // dummy byte
    };
-   if (!m_ds9490->Write1W(command, sizeof(command))) {
-      m_lastError = m_ds9490->GetLastError();
+   if (!m_ds9490->Write1W(command, sizeof(command), m_rom)) {
+      m_error = m_ds9490->GetError();
       return false;
    }
    return true;
 }
 
+/**
+ * @brief Starts a temperature conversion, whose result is read with ReadLatestTemperature()
+ * 
+ * The command returns immediately, the result is available after m_conversionTime. With ROM 0, the command
+ * is sent with Skip ROM, and all loggers on the bus convert at the same time. Loggers with a mission in
+ * progress ignore the command.
+ */
+bool DS1922::ForceConversion()
+{
+   if (m_statusRegisterValid && GetMissionInProgress()) {
+      m_error = DeviceError(DeviceError::MISSION_IN_PROGRESS);
+      return false;
+   }
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
+   uint8_t command[] = {0x55, // forced conversion
+      0xFF, 0xFF  // dummy bytes
+   };
+   if (!m_ds9490->Write1W(command, sizeof(command), m_rom)) {
+      m_error = m_ds9490->GetError();
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Reads the result of the last conversion in °C
+ * 
+ * ReadRegister() has to be called before, for the type of the logger. The register itself is not updated.
+ */
+bool DS1922::ReadLatestTemperature(double& temperature)
+{
+   if (!m_statusRegisterValid) {
+      m_error = DeviceError(DeviceError::NO_REGISTER);
+      return false;
+   }
+   if (!m_calibrationValid) {
+      ReadCalibration();
+   }
+   uint8_t page[32];
+   if (!ReadMemPage(0x0200, page))
+      return false;
+   // latest temperature: LSB at 0x020C, MSB at 0x020D
+   temperature = DS1922Decoder::ConvertValue(GetType(), m_calibrationValid ? m_calibration : NULL,
+      page[0x0D], page[0x0C]);
+   return true;
+}
+
 /**
  * @brief Clears the logging memory.
  */
 bool DS1922::ClearMemory()
 {
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
    uint8_t command[] = {0x96, // clear memory
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // dummy password (TODO: password)
       0xFF  // dummy byte
    };
-   if (!m_ds9490->Write1W(command, sizeof(command))) {
-      m_lastError = m_ds9490->GetLastError();
+   if (!m_ds9490->Write1W(command, sizeof(command), m_rom)) {
+      m_error = m_ds9490->GetError();
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Checks whether the logger with this ROM ID answers on the bus
+ * 
+ * Addresses the logger with Match ROM and reads the scratchpad address registers, which costs one reset and a
+ * few bytes instead of a search. Bit 6 of the E/S register always reads 0, while an absent device leaves the bus
+ * at 1.
+ * @return bool: false on errors of the adapter. An empty bus sets @p present to false.
+ */
+bool DS1922::CheckPresence(bool& present)
+{
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
+   uint8_t command[] = {0xAA}; // read scratchpad
+   uint8_t registers[3];
+   if (!m_ds9490->Write1W(command, sizeof(command), m_rom) || !m_ds9490->Read1W(registers, 3)) {
+      if (m_ds9490->GetError().code==DeviceError::NO_PRESENCE) {
+         present = false;
+         return true;
+      }
+      m_error = m_ds9490->GetError();
       return false;
    }
+   present = !(registers[2]&0x40);
    return true;
 }
 
@@ -260,32 +506,15 @@ bool DS1922::ReadCalibration()
       return false;
    if (!m_ds9490->DeviceOpen())
       if (!m_ds9490->OpenUsbDevice()) {
-         m_lastError = m_ds9490->GetLastError();
+         m_error = m_ds9490->GetError();
          return false;
       }
    uint8_t page[32];
    if (!ReadMemPage(0x0240, page)) {
       return false;
    }
-   // calculation according to datasheet
-   int tempOffset = 1;
-   double Tr1 = 90;
-   if (GetType()==DS1922L) {
-      tempOffset = 41;
-      Tr1 = 60;
-   }
-   double Tr2 = page[0]/2.0-tempOffset + page[1]/512.0,
-      Tc2 = page[2]/2.0-tempOffset + page[3]/512.0,
-      Tr3 = page[4]/2.0-tempOffset + page[5]/512.0,
-      Tc3 = page[6]/2.0-tempOffset + page[7]/512.0;
-         
-   double   Err2 = Tc2 - Tr2,
-      Err3 = Tc3 - Tr3;
-   double   Err1 = Err2; 
-   
-   m_calibration[1] = (Tr2*Tr2 - Tr1*Tr1)*(Err3-Err1)/((Tr2*Tr2-Tr1*Tr1)*(Tr3-Tr1)+(Tr3*Tr3-Tr1*Tr1)*(Tr1-Tr2));
-   m_calibration[0] = m_calibration[1]*(Tr1-Tr2)/(Tr2*Tr2-Tr1*Tr1);
-   m_calibration[2] = Err1 - m_calibration[0]*Tr1*Tr1 - m_calibration[1]*Tr1;
+   if (!DS1922Decoder::DecodeCalibration(GetType(), page, m_calibration))
+      return false;
    m_calibrationValid = true;
    return true;
 }
@@ -299,7 +528,7 @@ bool DS1922::ReadCalibration()
 bool DS1922::ReadData(double* buffer, int size)
 {
    if (!m_statusRegisterValid) {
-      m_lastError = "Read register first";
+      m_error = DeviceError(DeviceError::NO_REGISTER);
       return false;
    }
    if (!m_calibrationValid) {
@@ -309,6 +538,8 @@ bool DS1922::ReadData(double* buffer, int size)
    // converted to °C
    // read one pages at a time  
    uint8_t page[32];
+   const double* calibration = m_calibrationValid ? m_calibration : NULL;
+   DS1922Decoder::LogConverter convert = DS1922Decoder::GetLogConverter(GetType(), GetHighResLogging(), calibration!=NULL);
    int missionSamples = GetSampleCount();
    if (size > missionSamples)
    {
@@ -318,67 +549,268 @@ bool DS1922::ReadData(double* buffer, int size)
       int numPages = size/16 + (size%16 ? 1 : 0);
       for (int i=0; i<numPages; i++)
       {
-         if (!ReadMemPage(0x1000+i*32, page)) {
+         if (!ReadMemPage(0x1000+i*32, page) || !ReportProgress(i+1, numPages)) {
             return false;
          }
-         for (int j=0; j<16 && i*16+j<size; j++)
-         {
-            buffer[i*16+j] = ConvertValue(page[0+j*2], page[1+j*2]);
-         }
+         convert(page, std::min(16, size-i*16), calibration, buffer+i*16);
       }  
    } else { // 1 byte per value
       int numPages = size/32 + (size%32 ? 1 : 0);
       for (int i=0; i<numPages; i++)
       {
-         if (!ReadMemPage(0x1000+i*32, page)) {
+         if (!ReadMemPage(0x1000+i*32, page) || !ReportProgress(i+1, numPages)) {
             return false;
          }
-         for (int j=0; j<32 && i*32+j<size; j++)
-         {
-            buffer[i*32+j] = ConvertValue(page[j], 0);
-         }
+         convert(page, std::min(32, size-i*32), calibration, buffer+i*32);
       }  
    }
    return true;
 }
 
-double DS1922::ConvertValue(uint8_t hiByte, uint8_t loByte)
+/**
+ * @brief Read a range of logged samples into buffer
+ * 
+ * @p first is the number of the first sample in the mission, counting from 0. With rollover, only the last
+ * GetLogCapacity() samples of a mission are still available in the device. Only the pages holding the requested
+ * samples are read, so this can be used to download only the new samples of a running mission.
+ * The values returned in @p buffer are in °C.
+ */
+bool DS1922::ReadSamples(double* buffer, int first, int count)
+{
+   if (!m_statusRegisterValid) {
+      m_error = DeviceError(DeviceError::NO_REGISTER);
+      return false;
+   }
+   if (!m_calibrationValid) {
+      ReadCalibration();
+   }
+   int bytesPerSample = GetHighResLogging() ? 2 : 1;
+   std::vector<uint8_t> raw(count*bytesPerSample);
+   if (!ReadRawSamples(raw.data(), first, count)) {
+      return false;
+   }
+   const double* calibration = m_calibrationValid ? m_calibration : NULL;
+   DS1922Decoder::GetLogConverter(GetType(), bytesPerSample==2, calibration!=NULL)(raw.data(), count, calibration, buffer);
+   return true;
+}
+
+/**
+ * @brief Read a range of logged samples as stored in the device
+ * 
+ * Like ReadSamples(), but the samples are not converted. Each sample takes 2 bytes in @p buffer (high byte first)
+ * if GetHighResLogging() is true, otherwise 1 byte. Use ConvertRawValue() to convert them to °C.
+ */
+bool DS1922::ReadRawSamples(uint8_t* buffer, int first, int count)
+{
+   if (!CheckSampleRange(first, count))
+      return false;
+   int capacity = GetLogCapacity();
+   int bytesPerSample = GetHighResLogging() ? 2 : 1;
+   int samplesPerPage = 32/bytesPerSample;
+   int numPages = count>0 ? (first+count-1)/samplesPerPage - first/samplesPerPage + 1 : 0;
+   int pagesRead = 0;
+   uint8_t page[32];
+   int currentPage = -1;
+   for (int i=0; i<count; i++)
+   {
+      int pos = (first+i)%capacity;
+      if (pos/samplesPerPage != currentPage) {
+         currentPage = pos/samplesPerPage;
+         if (!ReadMemPage(0x1000+currentPage*32, page) || !ReportProgress(++pagesRead, numPages)) {
+            return false;
+         }
+      }
+      memcpy(buffer+i*bytesPerSample, page+(pos%samplesPerPage)*bytesPerSample, bytesPerSample);
+   }
+   return true;
+}
+
+/**
+ * @brief Reads a range of logged samples like ReadSamples(), coarse first and then refined
+ * 
+ * The pages are read in passes: first every m_previewStride-th page, which gives an overview of the whole range
+ * after a fraction of the transfer, then each pass reads the pages halfway between those already read. The
+ * samples not read yet are NaN. @p refined is called with the pages read and the total number of pages after
+ * each pass, and at least every m_previewStride-th of the pages, so the caller can show the partial data.
+ * Returning false from it cancels the download. The total number of pages read is the same as with
+ * ReadSamples().
+ */
+bool DS1922::ReadSamplesProgressive(double* buffer, int first, int count, std::function<bool(int, int)> refined)
+{
+   if (!CheckSampleRange(first, count))
+      return false;
+   if (!m_calibrationValid) {
+      ReadCalibration();
+   }
+   const double* calibration = m_calibrationValid ? m_calibration : NULL;
+   int bytesPerSample = GetHighResLogging() ? 2 : 1;
+   DS1922Decoder::LogConverter convert = DS1922Decoder::GetLogConverter(GetType(), bytesPerSample==2,
+      calibration!=NULL);
+   std::fill(buffer, buffer+count, std::numeric_limits<double>::quiet_NaN());
+   if (count==0)
+      return true;
+   int samplesPerPage = 32/bytesPerSample;
+   int pagesPerLog = GetLogCapacity()/samplesPerPage;
+   int firstSlot = first/samplesPerPage;     // page number within the mission, before wrapping
+   int numPages = (first+count-1)/samplesPerPage - firstSlot + 1;
+   
+   // reading order: 0, 16, 32, ..., then 8, 24, ..., then 4, 12, 20, ... and so on
+   std::vector<int> order;
+   std::vector<bool> passEnd(numPages, false);
+   order.reserve(numPages);
+   for (int stride=m_previewStride; stride>=1; stride/=2)
+   {
+      int start = stride==m_previewStride ? 0 : stride;
+      int step = stride==m_previewStride ? stride : 2*stride;
+      for (int j=start; j<numPages; j+=step)
+         order.push_back(j);
+      if (!order.empty())
+         passEnd[order.size()-1] = true;
+   }
+   int refineInterval = std::max(1, numPages/m_previewStride);
+   uint8_t page[32];
+   for (int i=0; i<numPages; i++)
+   {
+      int slot = firstSlot + order[i];
+      if (!ReadMemPage(0x1000 + (slot%pagesPerLog)*32, page) || !ReportProgress(i+1, numPages))
+         return false;
+      int begin = std::max(first, slot*samplesPerPage);
+      int end = std::min(first+count, (slot+1)*samplesPerPage);
+      convert(page + (begin-slot*samplesPerPage)*bytesPerSample, end-begin, calibration, buffer+begin-first);
+      if (refined && (passEnd[i] || (i+1)%refineInterval==0) && !refined(i+1, numPages)) {
+         m_error = DeviceError(DeviceError::CANCELLED);
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * @brief Converts a raw temperature value to °C
+ * 
+ * This does not need a device, e.g. for archived raw data.
+ * @param const double* calibration: the coefficients of the calibration correction, see GetCalibration(),
+ * or NULL to skip the correction.
+ */
+double DS1922::ConvertRawValue(Type type, const double* calibration, uint8_t hiByte, uint8_t loByte)
+{
+   return DS1922Decoder::ConvertValue(type, calibration, hiByte, loByte);
+}
+
+/**
+ * @brief Returns the coefficients of the calibration correction
+ * 
+ * The calibration memory is read from the device if needed.
+ * @return bool: false if the device has no calibration data or it could not be read.
+ */
+bool DS1922::GetCalibration(double* coefficients)
+{
+   if (!m_calibrationValid && !ReadCalibration())
+      return false;
+   memcpy(coefficients, m_calibration, sizeof(m_calibration));
+   return true;
+}
+
+/**
+ * @brief Copies the two configuration memory pages as read by ReadRegister()
+ * 
+ * @p pages must hold 64 bytes.
+ */
+void DS1922::GetRegister(uint8_t* pages)
 {
-   // convert to °C
-   int tempOffset = 1;
-   if (GetType()==DS1922L)
-      tempOffset = 41;
-   double result = hiByte/2.0-tempOffset + loByte/512.0; 
-   // apply calibration correction
-   if (m_calibrationValid) {
-      result -= m_calibration[0]*result*result + m_calibration[1]*result + m_calibration[2];
+   memcpy(pages, m_statusRegister, sizeof(m_statusRegister));
+}
+
+/**
+ * @brief Copies the register, the calibration and optionally the available logged samples into @p snapshot
+ * 
+ * Needs a successful ReadRegister(). With @p withLog, the samples still held by the device are read as raw
+ * values, taking rollover into account. A missing calibration is not an error.
+ */
+bool DS1922::TakeSnapshot(DS1922Snapshot& snapshot, bool withLog)
+{
+   if (!m_statusRegisterValid) {
+      m_error = DeviceError(DeviceError::NO_REGISTER);
+      return false;
    }
-   return result;
+   if (!m_calibrationValid) {
+      ReadCalibration();
+   }
+   int first = 0, count = 0;
+   std::vector<uint8_t> log;
+   if (withLog) {
+      count = GetSampleCount();
+      if (count>GetLogCapacity()) {
+         first = count-GetLogCapacity();
+         count = GetLogCapacity();
+      }
+      log.resize(count*(GetHighResLogging() ? 2 : 1));
+      if (!ReadRawSamples(log.data(), first, count))
+         return false;
+   }
+   snapshot = DS1922Snapshot(m_rom, m_statusRegister, m_calibrationValid ? m_calibration : NULL,
+      withLog ? log.data() : NULL, first, count);
+   return true;
 }
 
 bool DS1922::ReadMemPage(uint16_t address, uint8_t* buffer)
 {
+   BusArbiter::Transaction transaction(m_ds9490->GetArbiter(), m_priority);
    uint8_t command[] = {0x69, // read memory
       (uint8_t)(address&0xFF), (uint8_t)((address&0xFF00)>>8),
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // dummy password (TODO: password)
    };
-   if (!m_ds9490->Write1W(command, sizeof(command))) {
-      m_lastError = m_ds9490->GetLastError();
+   if (!m_ds9490->Write1W(command, sizeof(command), m_rom)) {
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
    if (!m_ds9490->Read1W(buffer, 32)) {
-      m_lastError = m_ds9490->GetLastError();
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
    uint8_t crcdata[3+32+2] = {0x69,
       (uint8_t)(address&0xFF), (uint8_t)((address&0xFF00)>>8)};
    memcpy(crcdata+3, buffer, 32);
    if (!m_ds9490->Read1W(crcdata+3+32, 2)) {
-      m_lastError = m_ds9490->GetLastError();
+      m_error = m_ds9490->GetError();
+      m_error.address = address;
       return false;
    }
    if (!VerifyCrc(crcdata, 3+32+2)) {
-      m_lastError = "Wrong CRC reading data";
+      m_error = DeviceError(DeviceError::CRC, 0, -1, address);
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Checks that the samples @p first to @p first + @p count are still held by the device
+ */
+bool DS1922::CheckSampleRange(int first, int count)
+{
+   if (!m_statusRegisterValid) {
+      m_error = DeviceError(DeviceError::NO_REGISTER);
+      return false;
+   }
+   int missionSamples = GetSampleCount();
+   if (first<0 || count<0 || first+count>missionSamples || first<missionSamples-GetLogCapacity()) {
+      m_error = DeviceError(DeviceError::SAMPLES_NOT_AVAILABLE);
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Passes the progress of a download to the progress handler
+ * 
+ * @return bool: false if the handler requested to cancel the download.
+ */
+bool DS1922::ReportProgress(int done, int total)
+{
+   if (m_progressHandler && !m_progressHandler(done, total)) {
+      m_error = DeviceError(DeviceError::CANCELLED);
       return false;
    }
    return true;
@@ -409,8 +841,18 @@ bool DS1922::VerifyCrc(uint8_t* data, int length)
  */
 int DS1922::GetSampleCount()
 {
-   return (m_statusRegister[0x22]<<16) | (m_statusRegister[0x21]<<8)
-      | (m_statusRegister[0x20]);
+   return DS1922Decoder::GetSampleCount(m_statusRegister);
+}
+
+/**
+ * @brief Number of samples the logging memory can hold
+ * 
+ * 8192 samples in 8 bit mode, 4096 in high resolution mode. With rollover enabled, older samples are overwritten
+ * once this number is exceeded.
+ */
+int DS1922::GetLogCapacity()
+{
+   return DS1922Decoder::GetLogCapacity(m_statusRegister);
 }
 
 /**
@@ -421,28 +863,17 @@ int DS1922::GetSampleCount()
  */
 int DS1922::GetDeviceSampleCount()
 {
-   return m_statusRegister[0x25]<<16 | m_statusRegister[0x24]<<8
-      | m_statusRegister[0x23];
+   return DS1922Decoder::GetDeviceSampleCount(m_statusRegister);
 }
 
 void DS1922::GetRtc(tm* time)
 {
-   time->tm_year  = 100+((m_statusRegister[5] & 0xf0)>>4) * 10 + (m_statusRegister[5] & 0x0f);
-   time->tm_mon   = ((m_statusRegister[4] & 0xf0)>>4) * 10 + (m_statusRegister[4] & 0x0f)-1;
-   time->tm_mday  = ((m_statusRegister[3] & 0xf0)>>4) * 10 + (m_statusRegister[3] & 0x0f);
-   time->tm_hour  = ((m_statusRegister[2] & 0xf0)>>4) * 10 + (m_statusRegister[2] & 0x0f);
-   time->tm_min   = ((m_statusRegister[1] & 0xf0)>>4) * 10 + (m_statusRegister[1] & 0x0f);
-   time->tm_sec   = ((m_statusRegister[0] & 0xf0)>>4) * 10 + (m_statusRegister[0] & 0x0f);
+   DS1922Decoder::DecodeTime(m_statusRegister, time);
 }
 
 void DS1922::GetMissionTimestamp(tm* time)
 {
-   time->tm_year  = 100+((m_statusRegister[0x1e] & 0xf0)>>4) * 10 + (m_statusRegister[0x1e] & 0x0f);
-   time->tm_mon   = ((m_statusRegister[0x1d] & 0xf0)>>4) * 10 + (m_statusRegister[0x1d] & 0x0f)-1;
-   time->tm_mday  = ((m_statusRegister[0x1c] & 0xf0)>>4) * 10 + (m_statusRegister[0x1c] & 0x0f);
-   time->tm_hour  = ((m_statusRegister[0x1b] & 0xf0)>>4) * 10 + (m_statusRegister[0x1b] & 0x0f);
-   time->tm_min   = ((m_statusRegister[0x1a] & 0xf0)>>4) * 10 + (m_statusRegister[0x1a] & 0x0f);
-   time->tm_sec   = ((m_statusRegister[0x19] & 0xf0)>>4) * 10 + (m_statusRegister[0x19] & 0x0f);
+   DS1922Decoder::DecodeTime(m_statusRegister+0x19, time);
 }
 
 /**
@@ -452,7 +883,7 @@ void DS1922::GetMissionTimestamp(tm* time)
  */
 int DS1922::GetSampleRate()
 {
-   return m_statusRegister[7]<<8 | m_statusRegister[6];
+   return DS1922Decoder::GetSampleRate(m_statusRegister);
 }
 
 /**
@@ -462,75 +893,67 @@ int DS1922::GetSampleRate()
  */
 bool DS1922::GetRtcEnabled()
 {
-   return (m_statusRegister[0x12]&0x1)==0x1;
+   return DS1922Decoder::GetRtcEnabled(m_statusRegister);
 }
 
 bool DS1922::GetHighspeedSampling()
 {
-   return (m_statusRegister[0x12]&0x2)==0x2;
+   return DS1922Decoder::GetHighspeedSampling(m_statusRegister);
 }
 
 bool DS1922::GetAlarmLowEnabled()
 {
-   return (m_statusRegister[0x10]&0x1)==0x1;
+   return DS1922Decoder::GetAlarmLowEnabled(m_statusRegister);
 }
 
 bool DS1922::GetAlarmHighEnabled()
 {
-   return (m_statusRegister[0x10]&0x2)==0x2;
+   return DS1922Decoder::GetAlarmHighEnabled(m_statusRegister);
 }
 
 double DS1922::GetAlarmLowThreshold()
 {
-   int tempOffset = 1;
-   if (GetType()==DS1922L)
-      tempOffset = 41;
-
-   return m_statusRegister[0x08]/2.0 - tempOffset;
+   return DS1922Decoder::GetAlarmLowThreshold(m_statusRegister);
 }
 
 double DS1922::GetAlarmHighThreshold()
 {
-   int tempOffset = 1;
-   if (GetType()==DS1922L)
-      tempOffset = 41;
-
-   return m_statusRegister[0x09]/2.0 - tempOffset;
+   return DS1922Decoder::GetAlarmHighThreshold(m_statusRegister);
 }
 
 bool DS1922::GetAlarmLow()
 {
-   return (m_statusRegister[0x14]&0x1)==0x1;
+   return DS1922Decoder::GetAlarmLow(m_statusRegister);
 }
 
 bool DS1922::GetAlarmHigh()
 {
-   return (m_statusRegister[0x14]&0x2)==0x2;
+   return DS1922Decoder::GetAlarmHigh(m_statusRegister);
 }
 
 bool DS1922::GetPasswordEnabled()
 {
-   return m_statusRegister[0x27]==0xaa;
+   return DS1922Decoder::GetPasswordEnabled(m_statusRegister);
 }
 
 bool DS1922::GetMissionInProgress()
 {
-   return (m_statusRegister[0x15]&0x2)==0x2;
+   return DS1922Decoder::GetMissionInProgress(m_statusRegister);
 }
 
 bool DS1922::GetWaitingForAlarm()
 {
-   return (m_statusRegister[0x15]&0x8)==0x8;
+   return DS1922Decoder::GetWaitingForAlarm(m_statusRegister);
 }
 
 bool DS1922::GetLoggingEnabled()
 {
-   return (m_statusRegister[0x13]&0x1)==0x1;
+   return DS1922Decoder::GetLoggingEnabled(m_statusRegister);
 }
 
 bool DS1922::GetHighResLogging()
 {
-   return (m_statusRegister[0x13]&0x4)==0x4;
+   return DS1922Decoder::GetHighResLogging(m_statusRegister);
 }
 
 /**
@@ -542,19 +965,17 @@ bool DS1922::GetHighResLogging()
  */
 bool DS1922::GetRollover()
 {
-   return (m_statusRegister[0x13]&0x10)==0x10;
+   return DS1922Decoder::GetRollover(m_statusRegister);
 }
 
 bool DS1922::GetStartUponAlarm()
 {
-   return (m_statusRegister[0x13]&0x20)==0x20;
+   return DS1922Decoder::GetStartUponAlarm(m_statusRegister);
 }
 
 int DS1922::GetMissionStartDelay()
 {
-   return m_statusRegister[0x18]<<16 | m_statusRegister[0x17]<<8
-      | m_statusRegister[0x16];
-
+   return DS1922Decoder::GetMissionStartDelay(m_statusRegister);
 }
 
 void DS1922::SetRtc(tm* time)
@@ -566,15 +987,16 @@ void DS1922::SetRtc(tm* time)
    m_statusRegister[1] = (time->tm_min/10)<<4 | time->tm_min%10;
    m_statusRegister[0] = (time->tm_sec/10)<<4 | time->tm_sec%10;
    
-   m_rtcChanged = true;
+   // the device clock runs on, so it is written even if unchanged
+   MarkDirty(0, 6);
 }
 
 void DS1922::SetSampleRate(int rate)
 {
    if ( (rate&0x3fff) > 0)
    {  // Datasheet: Setting rate=0 results in unrecoverable state
-      m_statusRegister[7] = (rate&0x3f00)>>8;
-      m_statusRegister[6] = rate&0xff;
+      SetRegister(7, (rate&0x3f00)>>8);
+      SetRegister(6, rate&0xff);
    }
 }
 
@@ -583,96 +1005,60 @@ void DS1922::SetSampleRate(int rate)
  */
 void DS1922::SetAlarmEnabled(bool tempLow, bool tempHigh)
 {
-   if (tempLow)
-      m_statusRegister[0x10] |= 1;
-   else
-      m_statusRegister[0x10] &= ~1;
-   if (tempHigh)
-      m_statusRegister[0x10] |= 2;
-   else
-      m_statusRegister[0x10] &= ~2;
+   SetRegisterBits(0x10, 1, tempLow);
+   SetRegisterBits(0x10, 2, tempHigh);
 }
 
 void DS1922::SetAlarmLowThreshold(double temp)
 {
-   int tempOffset = 1;
-   if (GetType()==DS1922L)
-      tempOffset = 41;
-
-   m_statusRegister[0x08] = (uint8_t)((temp+tempOffset)*2);
+   int tempOffset = DS1922Decoder::GetTemperatureOffset(GetType());
+   SetRegister(0x08, (uint8_t)((temp+tempOffset)*2));
 }
 
 void DS1922::SetAlarmHighThreshold(double temp)
 {
-   int tempOffset = 1;
-   if (GetType()==DS1922L)
-      tempOffset = 41;
-
-   m_statusRegister[0x09] = (uint8_t)((temp+tempOffset)*2);
+   int tempOffset = DS1922Decoder::GetTemperatureOffset(GetType());
+   SetRegister(0x09, (uint8_t)((temp+tempOffset)*2));
 }
 
 void DS1922::SetRtcEnabled(bool enabled)
 {
-   if (enabled)
-      m_statusRegister[0x12] |= 1;
-   else
-      m_statusRegister[0x12] &= ~1;
+   SetRegisterBits(0x12, 1, enabled);
 }
 
 void DS1922::SetRtcHighspeed(bool highspeed)
 {
-   if (highspeed)
-      m_statusRegister[0x12] |= 2;
-   else
-      m_statusRegister[0x12] &= ~2;
+   SetRegisterBits(0x12, 2, highspeed);
 }
 
 void DS1922::SetLoggingEnabled(bool enabled)
 {
-   if (enabled)
-      m_statusRegister[0x13] |= 1;
-   else
-      m_statusRegister[0x13] &= ~1;
+   SetRegisterBits(0x13, 1, enabled);
 }
 
 void DS1922::SetHighResLogging(bool highres)
 {
-   if (highres)
-      m_statusRegister[0x13] |= 4;
-   else
-      m_statusRegister[0x13] &= ~4;
+   SetRegisterBits(0x13, 4, highres);
 }
 
 void DS1922::SetRollover(bool rollover)
 {
-   if (rollover)
-      m_statusRegister[0x13] |= 0x10;
-   else
-      m_statusRegister[0x13] &= ~0x10;
+   SetRegisterBits(0x13, 0x10, rollover);
 }
 
 void DS1922::SetStartUponAlarm(bool startAlarm)
 {
-   if (startAlarm)
-      m_statusRegister[0x13] |= 0x20;
-   else
-      m_statusRegister[0x13] &= ~0x20;
+   SetRegisterBits(0x13, 0x20, startAlarm);
 }
 
 void DS1922::SetMissionStartDelay(int delay)
 {
-   m_statusRegister[0x18] = (delay&0xff0000)>>16;
-   m_statusRegister[0x17] = (delay&0xff00)>>8;
-   m_statusRegister[0x16] = (delay&0xff)>>0;
+   SetRegister(0x18, (delay&0xff0000)>>16);
+   SetRegister(0x17, (delay&0xff00)>>8);
+   SetRegister(0x16, (delay&0xff)>>0);
 }
 
 DS1922::Type DS1922::GetType()
 {
-   if (m_statusRegister[0x26]==0x40)
-      return DS1922L;
-   if (m_statusRegister[0x26]==0x60)
-      return DS1922T;
-   if (m_statusRegister[0x26]==0x80)
-      return DS1922E;
-   return Other;
+   return DS1922Decoder::GetType(m_statusRegister);
 }
@@ -21,8 +21,12 @@
 #define DS1922_H
 #include <string>
 #include <cstdint>
+#include <functional>
+#include "busarbiter.h"
+#include "deviceerror.h"
 
 class DS9490;
+class DS1922Snapshot;
 
 /**
  * @brief Represents a Maxim DS1922 1-Wire temperature sensor
@@ -32,27 +36,40 @@ class DS9490;
  * using the functions ReadRegister() and WriteRegister(). After reading, the configuration settings are 
  * available using the individual Get...() functions, and can be modified using the respective Set...()
  * functions. Only after calling WriteRegister() are the modified configurations written to the device.
- * Functions that interact with the hardware return false on error, and the error message can be retrieved 
- * using GetLastError().
+ * Functions that interact with the hardware return false on error, and the cause can be retrieved using
+ * GetError(), or as message using GetLastError().
+ * Downloads of logged data report their progress to the handler set with SetProgressHandler(), which can
+ * cancel the download by returning false.
+ * Several DS1922 objects can share one DS9490 from different threads. Each memory page is read or written as
+ * one transaction on the bus arbiter of the DS9490, at the priority set with SetPriority().
  */
 class DS1922
 {
 
 public:
-    DS1922(DS9490* ds9490);
+    DS1922(DS9490* ds9490, uint64_t rom=0);
     ~DS1922();
     
 public:
-   std::string GetLastError() {return m_lastError;}
+   std::string GetLastError() {return m_error.ToString();}
+   const DeviceError& GetError() {return m_error;}
    bool ReadRegister();
    bool WriteRegister();
    bool ReadData(double* buffer, int size);
+   bool ReadSamples(double* buffer, int first, int count);
+   bool ReadRawSamples(uint8_t* buffer, int first, int count);
+   bool ReadSamplesProgressive(double* buffer, int first, int count, std::function<bool(int, int)> refined);
+   bool SyncRtc(double* skew=NULL);
    bool StartMission();
    bool StopMission();
    bool ClearMemory();
+   bool ForceConversion();
+   bool ReadLatestTemperature(double& temperature);
+   bool CheckPresence(bool& present);
    
    int GetSampleCount();      // only valid after successful ReadRegister
    int GetDeviceSampleCount();// "
+   int GetLogCapacity();      // "
    void GetRtc(tm* time);     // "
    void GetMissionTimestamp(tm* time); // "
    int GetSampleRate();       // "
@@ -73,7 +90,17 @@ public:
    bool GetStartUponAlarm();  // "
    int GetMissionStartDelay();// "
    enum Type {DS1922L, DS1922T, DS1922E, Other};
+   static const uint8_t m_familyCode=0x41;  // 1-Wire family code of DS1922L/T/E
+   static const int m_conversionTime=600;   // ms, longest forced conversion
    DS1922::Type GetType();
+   uint64_t GetRom() {return m_rom;}
+   void SetRom(uint64_t rom) {m_rom = rom; m_statusRegisterValid = m_calibrationValid = false;}
+   bool GetCalibration(double* coefficients);
+   void GetRegister(uint8_t* pages);
+   bool TakeSnapshot(DS1922Snapshot& snapshot, bool withLog=true);
+   static double ConvertRawValue(Type type, const double* calibration, uint8_t hiByte, uint8_t loByte);
+   void SetPriority(BusArbiter::Priority priority) {m_priority = priority;}
+   void SetProgressHandler(std::function<bool(int, int)> handler) {m_progressHandler = handler;}
    
    void SetRtc(tm* time);
    void SetSampleRate(int rate);
@@ -91,19 +118,33 @@ public:
    
 protected:
    bool ReadMemPage(uint16_t address, uint8_t* buffer);
+   bool CheckSampleRange(int first, int count);
+   bool WritePage(uint16_t address, const uint8_t* data, int length);
+   bool WriteScratchpad(uint16_t address, const uint8_t* data, int length, uint8_t* verification);
+   bool CopyScratchpad(const uint8_t* verification);
+   void MarkDirty(int offset, int length);
+   void ClearDirty();
+   void SetRegister(int offset, uint8_t value);
+   void SetRegisterBits(int offset, uint8_t mask, bool set);
    bool VerifyCrc(uint8_t* data, int length);
-   double ConvertValue(uint8_t hiByte, uint8_t loByte);
+   bool ReportProgress(int done, int total);
    bool ReadCalibration();
    
    // Data
 private:
    DS9490* m_ds9490;
-   std::string m_lastError;
+   uint64_t m_rom;
+   BusArbiter::Priority m_priority;
+   std::function<bool(int, int)> m_progressHandler;
+   DeviceError m_error;
    uint8_t m_statusRegister[32*2];
    bool m_statusRegisterValid;
-   bool m_rtcChanged;
+   int m_dirtyBegin[2];   // changed byte range of each register page since the last read or write,
+   int m_dirtyEnd[2];     // empty if begin>=end
    double m_calibration[3];
    bool m_calibrationValid;
+   static const int m_copyTimeout=100;   // ms
+   static const int m_previewStride=16;  // pages between the pages of the first pass of ReadSamplesProgressive()
 };
 
 #endif // DS1922_H
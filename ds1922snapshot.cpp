@@ -0,0 +1,284 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "ds1922snapshot.h"
+#include <string.h>
+
+
+DS1922::Type DS1922Decoder::GetType(const uint8_t* pages)
+{
+   if (pages[0x26]==0x40)
+      return DS1922::DS1922L;
+   if (pages[0x26]==0x60)
+      return DS1922::DS1922T;
+   if (pages[0x26]==0x80)
+      return DS1922::DS1922E;
+   return DS1922::Other;
+}
+
+/**
+ * @brief Decodes the six BCD bytes of a clock or timestamp register into @p time
+ * 
+ * The logger keeps local time, so the fields can be passed to mktime() with tm_isdst = -1.
+ */
+void DS1922Decoder::DecodeTime(const uint8_t* bcd, tm* time)
+{
+   memset(time, 0, sizeof(*time));
+   time->tm_year  = 100+((bcd[5] & 0xf0)>>4) * 10 + (bcd[5] & 0x0f);
+   time->tm_mon   = ((bcd[4] & 0xf0)>>4) * 10 + (bcd[4] & 0x0f)-1;
+   time->tm_mday  = ((bcd[3] & 0xf0)>>4) * 10 + (bcd[3] & 0x0f);
+   time->tm_hour  = ((bcd[2] & 0xf0)>>4) * 10 + (bcd[2] & 0x0f);
+   time->tm_min   = ((bcd[1] & 0xf0)>>4) * 10 + (bcd[1] & 0x0f);
+   time->tm_sec   = ((bcd[0] & 0xf0)>>4) * 10 + (bcd[0] & 0x0f);
+   time->tm_isdst = -1;
+}
+
+/**
+ * @brief Decodes the six BCD bytes of a clock or timestamp register into seconds since epoch
+ */
+time_t DS1922Decoder::DecodeTime(const uint8_t* bcd)
+{
+   tm time;
+   DecodeTime(bcd, &time);
+   return mktime(&time);
+}
+
+/**
+ * @brief Computes the calibration coefficients of a logger of type @p type, see DS1922Decoder::DecodeCalibration()
+ */
+template<DS1922::Type type>
+static bool DecodeCalibration(const uint8_t* page, double* coefficients)
+{
+   typedef DS1922Traits<type> Traits;
+   if (!Traits::hasCalibration)
+      return false;
+   // calculation according to datasheet
+   const int tempOffset = Traits::temperatureOffset;
+   const double Tr1 = Traits::calibrationReference;
+   double Tr2 = page[0]/2.0-tempOffset + page[1]/512.0,
+      Tc2 = page[2]/2.0-tempOffset + page[3]/512.0,
+      Tr3 = page[4]/2.0-tempOffset + page[5]/512.0,
+      Tc3 = page[6]/2.0-tempOffset + page[7]/512.0;
+         
+   double   Err2 = Tc2 - Tr2,
+      Err3 = Tc3 - Tr3;
+   double   Err1 = Err2; 
+   
+   coefficients[1] = (Tr2*Tr2 - Tr1*Tr1)*(Err3-Err1)/((Tr2*Tr2-Tr1*Tr1)*(Tr3-Tr1)+(Tr3*Tr3-Tr1*Tr1)*(Tr1-Tr2));
+   coefficients[0] = coefficients[1]*(Tr1-Tr2)/(Tr2*Tr2-Tr1*Tr1);
+   coefficients[2] = Err1 - coefficients[0]*Tr1*Tr1 - coefficients[1]*Tr1;
+   return true;
+}
+
+/**
+ * @brief Computes the coefficients of the calibration correction from calibration memory page 0x0240
+ * 
+ * @return bool: false if the type has no calibration data.
+ */
+bool DS1922Decoder::DecodeCalibration(DS1922::Type type, const uint8_t* page, double* coefficients)
+{
+   switch (type)
+   {
+   case DS1922::DS1922L:
+      return ::DecodeCalibration<DS1922::DS1922L>(page, coefficients);
+   case DS1922::DS1922E:
+      return ::DecodeCalibration<DS1922::DS1922E>(page, coefficients);
+   case DS1922::DS1922T:
+      return ::DecodeCalibration<DS1922::DS1922T>(page, coefficients);
+   default:
+      return ::DecodeCalibration<DS1922::Other>(page, coefficients);
+   }
+}
+
+/**
+ * @brief Converts @p count samples to °C
+ * 
+ * @p samples are either the bytes of the logging memory, high byte first in high resolution mode, or raw
+ * values as returned by ArchiveReader::GetRawValues(). All constants are template parameters, so the loop
+ * does not branch and can be vectorized.
+ */
+template<DS1922::Type type, int bytesPerSample, bool calibrated, typename Sample>
+static void ConvertSamples(const Sample* samples, int count, const double* calibration, double* buffer)
+{
+   // one step of the raw value is 1/512 °C in high resolution, 1/2 °C otherwise
+   constexpr double scale = bytesPerSample==2 ? 1/512.0 : 1/2.0;
+   constexpr double offset = DS1922Traits<type>::temperatureOffset;
+   double c0 = 0, c1 = 0, c2 = 0;
+   if constexpr (calibrated) {
+      c0 = calibration[0];
+      c1 = calibration[1];
+      c2 = calibration[2];
+   }
+   for (int i=0; i<count; i++)
+   {
+      int32_t raw;
+      if constexpr (sizeof(Sample)==1 && bytesPerSample==2)
+         raw = samples[i*2]<<8 | samples[i*2+1];
+      else
+         raw = samples[i];
+      double result = raw*scale - offset;
+      // apply calibration correction
+      if constexpr (calibrated)
+         result -= c0*result*result + c1*result + c2;
+      buffer[i] = result;
+   }
+}
+
+template<typename Sample>
+using Converter = void (*)(const Sample* samples, int count, const double* calibration, double* buffer);
+
+template<DS1922::Type type, typename Sample>
+static Converter<Sample> SelectConverter(bool highRes, bool calibrated)
+{
+   calibrated = calibrated && DS1922Traits<type>::hasCalibration;
+   if (highRes)
+      return calibrated ? ConvertSamples<type, 2, true, Sample> : ConvertSamples<type, 2, false, Sample>;
+   return calibrated ? ConvertSamples<type, 1, true, Sample> : ConvertSamples<type, 1, false, Sample>;
+}
+
+template<typename Sample>
+static Converter<Sample> SelectConverter(DS1922::Type type, bool highRes, bool calibrated)
+{
+   switch (type)
+   {
+   case DS1922::DS1922L:
+      return SelectConverter<DS1922::DS1922L, Sample>(highRes, calibrated);
+   case DS1922::DS1922E:
+      return SelectConverter<DS1922::DS1922E, Sample>(highRes, calibrated);
+   case DS1922::DS1922T:
+      return SelectConverter<DS1922::DS1922T, Sample>(highRes, calibrated);
+   default:
+      return SelectConverter<DS1922::Other, Sample>(highRes, calibrated);
+   }
+}
+
+/**
+ * @brief Selects the conversion kernel for samples in the format of the logging memory
+ * 
+ * The kernel converts 2 bytes per sample if @p highRes, otherwise 1 byte. With @p calibrated, it applies
+ * the correction passed as calibration, which must then not be NULL.
+ */
+DS1922Decoder::LogConverter DS1922Decoder::GetLogConverter(DS1922::Type type, bool highRes, bool calibrated)
+{
+   return SelectConverter<uint8_t>(type, highRes, calibrated);
+}
+
+/**
+ * @brief Selects the conversion kernel for raw values as returned by ArchiveReader::GetRawValues()
+ */
+DS1922Decoder::RawConverter DS1922Decoder::GetRawConverter(DS1922::Type type, bool highRes, bool calibrated)
+{
+   return SelectConverter<int32_t>(type, highRes, calibrated);
+}
+
+/**
+ * @brief Converts a raw temperature value to °C
+ * 
+ * For single values. Sample data should be converted with the kernel returned by GetLogConverter().
+ * @param const double* calibration: the coefficients of the calibration correction, see DecodeCalibration(),
+ * or NULL to skip the correction.
+ */
+double DS1922Decoder::ConvertValue(DS1922::Type type, const double* calibration, uint8_t hiByte, uint8_t loByte)
+{
+   uint8_t sample[2] = {hiByte, loByte};
+   double result;
+   GetLogConverter(type, true, calibration!=NULL)(sample, 1, calibration, &result);
+   return result;
+}
+
+
+/**
+ * @brief Constructs an invalid, empty snapshot
+ */
+DS1922Snapshot::DS1922Snapshot()
+{
+   m_valid = false;
+   m_rom = 0;
+   memset(m_register, 0, sizeof(m_register));
+   m_type = DS1922::Other;
+   m_rtc = 0;
+   m_missionTimestamp = 0;
+   m_interval = 0;
+   memset(m_calibration, 0, sizeof(m_calibration));
+   m_calibrationValid = false;
+   m_firstSample = 0;
+   m_logSamples = 0;
+   m_bytesPerSample = 1;
+   m_converter = DS1922Decoder::GetLogConverter(m_type, false, false);
+}
+
+/**
+ * @brief Constructor
+ * 
+ * @param const uint8_t* registerPages: the 64 bytes of the configuration memory pages 0x0200-0x023F.
+ * @param const double* calibration: the coefficients of the calibration correction, or NULL if not available.
+ * @param const uint8_t* log: raw logged samples in the format of the logging memory, 1 or 2 bytes per sample
+ * depending on the resolution in @p registerPages, or NULL.
+ * @param int firstSample: mission sample number of the first sample in @p log.
+ * @param int logSamples: number of samples in @p log.
+ */
+DS1922Snapshot::DS1922Snapshot(uint64_t rom, const uint8_t* registerPages, const double* calibration,
+   const uint8_t* log, int firstSample, int logSamples)
+{
+   m_valid = true;
+   m_rom = rom;
+   memcpy(m_register, registerPages, sizeof(m_register));
+   m_type = DS1922Decoder::GetType(m_register);
+   m_rtc = DS1922Decoder::DecodeTime(m_register);
+   m_missionTimestamp = DS1922Decoder::DecodeTime(m_register+0x19);
+   m_interval = GetSampleRate() * (GetHighspeedSampling() ? 1 : 60);
+   m_calibrationValid = calibration!=NULL;
+   if (calibration)
+      memcpy(m_calibration, calibration, sizeof(m_calibration));
+   else
+      memset(m_calibration, 0, sizeof(m_calibration));
+   m_bytesPerSample = GetHighResLogging() ? 2 : 1;
+   m_converter = DS1922Decoder::GetLogConverter(m_type, m_bytesPerSample==2, m_calibrationValid);
+   m_firstSample = firstSample;
+   m_logSamples = log ? logSamples : 0;
+   if (log)
+      m_log.assign(log, log+m_logSamples*m_bytesPerSample);
+}
+
+/**
+ * @brief Returns logged sample @p i in °C, counting from GetFirstSample()
+ */
+double DS1922Snapshot::GetValue(int i) const
+{
+   double result;
+   m_converter(m_log.data()+i*m_bytesPerSample, 1, m_calibration, &result);
+   return result;
+}
+
+/**
+ * @brief Converts up to @p count logged samples, starting at mission sample @p first, to °C
+ * 
+ * @return int: the number of values written to @p buffer, which is less than @p count if the snapshot
+ * does not hold all requested samples.
+ */
+int DS1922Snapshot::GetValues(double* buffer, int first, int count) const
+{
+   int begin = first - m_firstSample;
+   if (begin<0 || begin>=m_logSamples || count<=0)
+      return 0;
+   if (count>m_logSamples-begin)
+      count = m_logSamples-begin;
+   m_converter(m_log.data()+begin*m_bytesPerSample, count, m_calibration, buffer);
+   return count;
+}
@@ -0,0 +1,178 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DS1922SNAPSHOT_H
+#define DS1922SNAPSHOT_H
+#include <cstdint>
+#include <ctime>
+#include <vector>
+#include "ds1922.h"
+
+/**
+ * @brief Conversion constants of the DS1922 variants
+ * 
+ * The temperature registers hold (T + temperatureOffset) * 2 in the high byte and the remaining 1/512 °C in the
+ * low byte. calibrationReference is the first reference temperature Tr1 of the calibration memory, in °C.
+ */
+template<DS1922::Type type> struct DS1922Traits
+{
+   static constexpr int temperatureOffset = 1;
+   static constexpr double calibrationReference = 90;
+   static constexpr bool hasCalibration = true;
+};
+
+template<> struct DS1922Traits<DS1922::DS1922L>
+{
+   static constexpr int temperatureOffset = 41;
+   static constexpr double calibrationReference = 60;
+   static constexpr bool hasCalibration = true;
+};
+
+template<> struct DS1922Traits<DS1922::DS1922E>
+{
+   static constexpr int temperatureOffset = 1;
+   static constexpr double calibrationReference = 90;
+   static constexpr bool hasCalibration = false;
+};
+
+/**
+ * @brief Decodes the configuration memory pages of a DS1922
+ * 
+ * All functions are static and work on a copy of the 64 bytes of the pages 0x0200-0x023F, as returned by
+ * DS1922::GetRegister() or stored in an archive, so they do not need a device.
+ * Logged samples are converted by kernels specialized for logger type, resolution and calibration. The
+ * kernel is selected once per mission with GetLogConverter() or GetRawConverter(), so the conversion loops
+ * do not branch per sample.
+ */
+class DS1922Decoder
+{
+public:
+   static DS1922::Type GetType(const uint8_t* pages);
+   static constexpr int GetTemperatureOffset(DS1922::Type type)
+      {return type==DS1922::DS1922L ? DS1922Traits<DS1922::DS1922L>::temperatureOffset
+         : DS1922Traits<DS1922::DS1922T>::temperatureOffset;}
+   static time_t DecodeTime(const uint8_t* bcd);
+   static void DecodeTime(const uint8_t* bcd, tm* time);
+   static int GetSampleCount(const uint8_t* pages)
+      {return pages[0x22]<<16 | pages[0x21]<<8 | pages[0x20];}
+   static int GetDeviceSampleCount(const uint8_t* pages)
+      {return pages[0x25]<<16 | pages[0x24]<<8 | pages[0x23];}
+   static int GetSampleRate(const uint8_t* pages) {return pages[7]<<8 | pages[6];}
+   static int GetMissionStartDelay(const uint8_t* pages)
+      {return pages[0x18]<<16 | pages[0x17]<<8 | pages[0x16];}
+   static double GetAlarmLowThreshold(const uint8_t* pages)
+      {return pages[0x08]/2.0 - GetTemperatureOffset(GetType(pages));}
+   static double GetAlarmHighThreshold(const uint8_t* pages)
+      {return pages[0x09]/2.0 - GetTemperatureOffset(GetType(pages));}
+   static bool GetRtcEnabled(const uint8_t* pages) {return (pages[0x12]&0x1)==0x1;}
+   static bool GetHighspeedSampling(const uint8_t* pages) {return (pages[0x12]&0x2)==0x2;}
+   static bool GetAlarmLowEnabled(const uint8_t* pages) {return (pages[0x10]&0x1)==0x1;}
+   static bool GetAlarmHighEnabled(const uint8_t* pages) {return (pages[0x10]&0x2)==0x2;}
+   static bool GetLoggingEnabled(const uint8_t* pages) {return (pages[0x13]&0x1)==0x1;}
+   static bool GetHighResLogging(const uint8_t* pages) {return (pages[0x13]&0x4)==0x4;}
+   static bool GetRollover(const uint8_t* pages) {return (pages[0x13]&0x10)==0x10;}
+   static bool GetStartUponAlarm(const uint8_t* pages) {return (pages[0x13]&0x20)==0x20;}
+   static bool GetAlarmLow(const uint8_t* pages) {return (pages[0x14]&0x1)==0x1;}
+   static bool GetAlarmHigh(const uint8_t* pages) {return (pages[0x14]&0x2)==0x2;}
+   static bool GetMissionInProgress(const uint8_t* pages) {return (pages[0x15]&0x2)==0x2;}
+   static bool GetWaitingForAlarm(const uint8_t* pages) {return (pages[0x15]&0x8)==0x8;}
+   static bool GetPasswordEnabled(const uint8_t* pages) {return pages[0x27]==0xaa;}
+   static int GetLogCapacity(const uint8_t* pages) {return GetHighResLogging(pages) ? 4096 : 8192;}
+   static bool DecodeCalibration(DS1922::Type type, const uint8_t* page, double* coefficients);
+   static double ConvertValue(DS1922::Type type, const double* calibration, uint8_t hiByte, uint8_t loByte);
+   
+   typedef void (*LogConverter)(const uint8_t* log, int count, const double* calibration, double* buffer);
+   typedef void (*RawConverter)(const int32_t* raw, int count, const double* calibration, double* buffer);
+   static LogConverter GetLogConverter(DS1922::Type type, bool highRes, bool calibrated);
+   static RawConverter GetRawConverter(DS1922::Type type, bool highRes, bool calibrated);
+};
+
+/**
+ * @brief Immutable copy of the state of a DS1922 at one point in time
+ * 
+ * Holds the configuration memory pages, the calibration coefficients and the raw logged samples, and decodes
+ * them with DS1922Decoder without a device. A snapshot can be taken from a logger with DS1922::TakeSnapshot()
+ * or rebuilt from an archived mission with ArchiveReader::GetSnapshot(), so the same code can display both.
+ * The clock, the mission timestamp and the sample interval are decoded once on construction.
+ * Snapshots are plain values and can be copied and passed between threads.
+ */
+class DS1922Snapshot
+{
+public:
+   DS1922Snapshot();
+   DS1922Snapshot(uint64_t rom, const uint8_t* registerPages, const double* calibration=NULL,
+      const uint8_t* log=NULL, int firstSample=0, int logSamples=0);
+   
+public:
+   bool IsValid() const {return m_valid;}
+   uint64_t GetRom() const {return m_rom;}
+   const uint8_t* GetRegister() const {return m_register;}
+   DS1922::Type GetType() const {return m_type;}
+   time_t GetRtc() const {return m_rtc;}
+   time_t GetMissionTimestamp() const {return m_missionTimestamp;}
+   int GetInterval() const {return m_interval;}
+   time_t GetSampleTime(int sample) const {return m_missionTimestamp + (time_t)sample*m_interval;}
+   const double* GetCalibration() const {return m_calibrationValid ? m_calibration : NULL;}
+   
+   int GetSampleCount() const {return DS1922Decoder::GetSampleCount(m_register);}
+   int GetDeviceSampleCount() const {return DS1922Decoder::GetDeviceSampleCount(m_register);}
+   int GetLogCapacity() const {return DS1922Decoder::GetLogCapacity(m_register);}
+   int GetSampleRate() const {return DS1922Decoder::GetSampleRate(m_register);}
+   int GetMissionStartDelay() const {return DS1922Decoder::GetMissionStartDelay(m_register);}
+   double GetAlarmLowThreshold() const {return DS1922Decoder::GetAlarmLowThreshold(m_register);}
+   double GetAlarmHighThreshold() const {return DS1922Decoder::GetAlarmHighThreshold(m_register);}
+   bool GetRtcEnabled() const {return DS1922Decoder::GetRtcEnabled(m_register);}
+   bool GetHighspeedSampling() const {return DS1922Decoder::GetHighspeedSampling(m_register);}
+   bool GetAlarmLowEnabled() const {return DS1922Decoder::GetAlarmLowEnabled(m_register);}
+   bool GetAlarmHighEnabled() const {return DS1922Decoder::GetAlarmHighEnabled(m_register);}
+   bool GetAlarmLow() const {return DS1922Decoder::GetAlarmLow(m_register);}
+   bool GetAlarmHigh() const {return DS1922Decoder::GetAlarmHigh(m_register);}
+   bool GetPasswordEnabled() const {return DS1922Decoder::GetPasswordEnabled(m_register);}
+   bool GetMissionInProgress() const {return DS1922Decoder::GetMissionInProgress(m_register);}
+   bool GetWaitingForAlarm() const {return DS1922Decoder::GetWaitingForAlarm(m_register);}
+   bool GetLoggingEnabled() const {return DS1922Decoder::GetLoggingEnabled(m_register);}
+   bool GetHighResLogging() const {return DS1922Decoder::GetHighResLogging(m_register);}
+   bool GetRollover() const {return DS1922Decoder::GetRollover(m_register);}
+   bool GetStartUponAlarm() const {return DS1922Decoder::GetStartUponAlarm(m_register);}
+   
+   int GetFirstSample() const {return m_firstSample;}
+   int GetLogSamples() const {return m_logSamples;}
+   const uint8_t* GetLog() const {return m_log.data();}
+   double GetValue(int i) const;
+   int GetValues(double* buffer, int first, int count) const;
+   
+   // Data
+private:
+   bool m_valid;
+   uint64_t m_rom;
+   uint8_t m_register[32*2];
+   DS1922::Type m_type;
+   time_t m_rtc;
+   time_t m_missionTimestamp;
+   int m_interval;            // seconds
+   double m_calibration[3];
+   bool m_calibrationValid;
+   std::vector<uint8_t> m_log;// raw samples as stored in the logging memory, without rollover wrap
+   int m_firstSample;
+   int m_logSamples;
+   int m_bytesPerSample;
+   DS1922Decoder::LogConverter m_converter;
+};
+
+#endif // DS1922SNAPSHOT_H
@@ -19,11 +19,19 @@
 
 #include "ds9490.h"
 #include <iostream>  // Für std::cerr und std::endl
+#include <cmath>
+#include <errno.h>
+#include <time.h>
 
 
 DS9490::DS9490()
 {
    m_usbDevHandle = NULL;
+   m_devicePresent = false;
+   m_resultCode = 0;
+   m_deviceAttached = false;
+   m_latency = -1;
+   m_latencyDeviation = 0;
 }
 
 DS9490::~DS9490()
@@ -34,14 +42,44 @@ DS9490::~DS9490()
    }  
 }
 
+/**
+ * @brief Counts the DS9490 USB devices currently attached
+ * 
+ * The USB busses are rescanned on every call, so polling this function detects adapters being plugged in
+ * or removed.
+ */
+int DS9490::CountUsbDevices()
+{
+   struct usb_bus *bus;
+   struct usb_device *dev;
+   int count = 0;
+
+   usb_init();
+   usb_set_debug(0);
+   usb_find_busses();
+   usb_find_devices();
+
+   for (bus = usb_busses; bus; bus = bus->next) {
+      for (dev = bus->devices; dev; dev = dev->next) {
+         if (dev->descriptor.idVendor == 0x04FA &&
+               dev->descriptor.idProduct == 0x2490) {
+            count++;
+         }
+      }
+   }
+   return count;
+}
+
 /**
  * @brief Searches for a DS9490 USB device and opens a handle
  * 
- * Currently, only one USB device is supported, so the first one found is used. 
+ * If more than one adapter is attached, @p index selects which one is used, counting in the order of
+ * the USB busses, see CountUsbDevices().
  * @return bool: true on success, false on failure. On failure, an error message is available from GetLastError().
  */
-bool DS9490::OpenUsbDevice()
+bool DS9490::OpenUsbDevice(int index)
 {
+   BusArbiter::Transaction transaction(&m_arbiter, BusArbiter::Normal);
    struct usb_bus *bus;
    struct usb_device *dev;
 
@@ -55,13 +93,13 @@ bool DS9490::OpenUsbDevice()
       for (dev = bus->devices; dev; dev = dev->next) {
          if (dev->descriptor.idVendor == 0x04FA &&
                dev->descriptor.idProduct == 0x2490) {
-            // take the first one, support only one DS9490B 
-            return AquireUsb(dev);
+            if (index--==0)
+               return AquireUsb(dev);
          }
       }
    }
 
-   m_lastError = "No DS2490 found";
+   m_error = DeviceError(DeviceError::NO_ADAPTER);
    return false;
 }
 
@@ -74,29 +112,42 @@ bool DS9490::AquireUsb(struct usb_device* dev)
    m_usbDevHandle = usb_open(dev);
    if (m_usbDevHandle==NULL)
    {
-      m_lastError = "Failed to open USB device";
+      m_error = DeviceError(DeviceError::USB_OPEN);
       return false;
    }
    if (usb_set_configuration(m_usbDevHandle, 1) != 0) {
-      m_lastError = "Failed to set configuration";
+      m_error = DeviceError(DeviceError::USB_CONFIGURATION);
       Release();
       return false;
    }
    if (usb_claim_interface(m_usbDevHandle, 0)!=0)
    {
-      m_lastError = "Failed to claim interface";
+      m_error = DeviceError(DeviceError::USB_INTERFACE);
       Release();
       return false;
    }
    if (usb_set_altinterface(m_usbDevHandle, 3)!=0)
    {
-      m_lastError = "Failed to set altinterface\n";
+      m_error = DeviceError(DeviceError::USB_ALTINTERFACE);
       Release();
       return false;
    }
    return true;
 }
 
+/**
+ * @brief Closes the handle to the USB device, e.g. after the adapter was unplugged
+ */
+void DS9490::CloseUsbDevice()
+{
+   BusArbiter::Transaction transaction(&m_arbiter, BusArbiter::Normal);
+   if (m_usbDevHandle)
+   {
+      Release();
+   }
+   m_devicePresent = false;
+}
+
 bool DS9490::Release()
 {
    usb_release_interface(m_usbDevHandle, 0);
@@ -108,72 +159,116 @@ bool DS9490::Release()
 /**
  * @brief Scan the 1-Wire bus for devices
  * 
- * The found devices are returned in @p serials. 
+ * The found devices are returned in @p serials, in the order of the search. With @p family other than 0, the
+ * search starts at that family code and stops after its last device, so other devices on the bus are not
+ * enumerated. With @p alarmOnly, the Conditional Search ROM command is used, and only devices in an alarm
+ * state take part.
  */
-bool DS9490::Scan1WBus(std::list<uint64_t>& serials)
+bool DS9490::Scan1WBus(std::list<uint64_t>& serials, uint8_t family, bool alarmOnly)
 {
+   BusArbiter::Transaction transaction(&m_arbiter, BusArbiter::Normal);
    if (!DeviceOpen()) {
-      m_lastError = "Device not open";
+      m_error = DeviceError(DeviceError::NOT_OPEN);
       return false;
    }
-   uint64_t lastSerial = 0;
-   int lastDiscrepancy = 0;
+   SearchState state;
+   state.rom = family;
+   state.lastDiscrepancy = family ? 64 : 0;   // follow the preset family code first
+   state.lastDevice = false;
+   bool found;
+   while (!state.lastDevice) {
+      if (!SearchRom(state, alarmOnly ? 0xEC : 0xF0, found))
+         return false;
+      if (!found || (family && (state.rom&0xFF)!=family))
+         break;
+      serials.push_back(state.rom);
+   }
+   return true;
+}
 
-   if (!DeviceOpen()) {
-      m_lastError = "Device not open";
-      return false;
+static uint8_t Crc8(uint8_t crc, uint8_t data)
+{
+   for (int i=0; i<8; i++) {
+      bool mix = (crc^data)&1;
+      crc >>= 1;
+      if (mix)
+         crc ^= 0x8C;
+      data >>= 1;
    }
-   do {
-      uint64_t currSerial = 0;
-      if (!Reset1W())
-         return false;
-      if (!WriteByte(0xF0)) // search ROM
+   return crc;
+}
+
+/**
+ * @brief Searches the next device on the bus, following Maxim application note 187
+ * 
+ * @p state holds the result of the previous search and is updated. Bit numbers count from 1, a discrepancy of 0
+ * means none. @p found is false if no further device answered, or the ROM ID failed its CRC check.
+ * @param uint8_t command: 0xF0 for Search ROM, 0xEC for Conditional Search ROM
+ */
+bool DS9490::SearchRom(SearchState& state, uint8_t command, bool& found)
+{
+   found = false;
+   if (!Reset1W())
+      return false;
+   if (!m_devicePresent)
+      return true;   // empty bus
+   if (!WriteByte(command))
+      return false;
+   /* three timeslots for each bit:
+   * 1. all participating devices return address bit
+   * 2. all participating devices return inverted address bit
+   * 3. master sends chosen address bit 
+   */
+   uint64_t rom = 0;
+   int lastZero = 0;
+   uint8_t crc = 0;
+   for (int bitNumber=1; bitNumber<=64; bitNumber++)
+   {
+      uint8_t bit, complement;
+      if (!TouchBit(1, bit) || !TouchBit(1, complement))
          return false;
-      /* three timeslots for each bit:
-      * 1. all participating devices return address bit
-      * 2. all participating devices return inverted address bit
-      * 3. master sends chosen address bit 
-      */
-      uint8_t bit1, bit2;
-      uint8_t lastZero = 0;
-      for (int bitNumber=0; bitNumber<64; bitNumber++)
-      {
-         if (!TouchBit(1, bit1) || !TouchBit(1, bit2))
-            return false;
-         if (bit1 && bit2) 
-            return true; // no device on bus
-         
-         uint8_t searchDirection;
-         if (bit1!=bit2) {
-            // only one bit is present
-            searchDirection = bit1;
-         } else {
-            // both bits present, use 0 first
-            if (bitNumber<lastDiscrepancy)
-               searchDirection = (lastSerial>>bitNumber)&1;
-            else if (bitNumber==lastDiscrepancy)
-               searchDirection = 1;
-            else 
-               searchDirection = 0;
-            
-            if (searchDirection==0)
-               lastZero = bitNumber;
-         }
-         TouchBit(searchDirection, bit1);
-         currSerial |= searchDirection<<bitNumber;
+      if (bit && complement) {
+         // no device participating, e.g. none in alarm state
+         state.lastDiscrepancy = 0;
+         state.lastDevice = true;
+         return true;
       }
-      serials.push_back(currSerial);
-      lastSerial = currSerial;
-      lastDiscrepancy = lastZero;
-   } while (lastDiscrepancy!=0);
-   
+      uint8_t direction;
+      if (bit!=complement) {
+         // all participating devices have the same bit
+         direction = bit;
+      } else {
+         // discrepancy: repeat the previous path before the last discrepancy, take 1 there, 0 after it
+         if (bitNumber<state.lastDiscrepancy)
+            direction = (state.rom>>(bitNumber-1))&1;
+         else
+            direction = bitNumber==state.lastDiscrepancy;
+         if (direction==0)
+            lastZero = bitNumber;
+      }
+      if (!TouchBit(direction, bit))
+         return false;
+      rom |= (uint64_t)direction<<(bitNumber-1);
+      if (bitNumber%8==0)
+         crc = Crc8(crc, (rom>>(bitNumber-8))&0xFF);
+   }
+   if (crc!=0 || (rom&0xFF)==0) {
+      state.lastDiscrepancy = 0;
+      state.lastDevice = true;
+      return true;
+   }
+   state.rom = rom;
+   state.lastDiscrepancy = lastZero;
+   state.lastDevice = lastZero==0;
+   found = true;
    return true;
 }
 
 bool DS9490::Read1W(uint8_t* buffer, uint length)
 {
+   BusArbiter::Transaction transaction(&m_arbiter, BusArbiter::Normal);
    if (!DeviceOpen()) {
-      m_lastError = "Device not open";
+      m_error = DeviceError(DeviceError::NOT_OPEN);
       return false;
    }
    for (int i=0; i<length; i++) {
@@ -184,16 +279,32 @@ bool DS9490::Read1W(uint8_t* buffer, uint length)
    return true;
 }
 
-bool DS9490::Write1W(uint8_t* buffer, uint length)
+/**
+ * @brief Resets the bus, addresses a device and writes @p buffer
+ * 
+ * The device is selected by @p rom using Match ROM. With @p rom 0, Skip ROM is used, which only works
+ * with a single device on the bus.
+ */
+bool DS9490::Write1W(uint8_t* buffer, uint length, uint64_t rom)
 {
+   BusArbiter::Transaction transaction(&m_arbiter, BusArbiter::Normal);
    if (!DeviceOpen()) {
-      m_lastError = "Device not open";
+      m_error = DeviceError(DeviceError::NOT_OPEN);
       return false;
    }
-   if (!Reset1W())
-      return false;
-   if (!WriteByte(0xCC))   // skip ROM
+   if (!ResetPresent())
       return false;
+   if (rom==0) {
+      if (!WriteByte(0xCC))   // skip ROM
+         return false;
+   } else {
+      if (!WriteByte(0x55))   // match ROM
+         return false;
+      for (int i=0; i<8; i++) {
+         if (!WriteByte((rom>>(i*8))&0xFF))
+            return false;
+      }
+   }
    
    for (int i=0; i<length; i++)
    {
@@ -205,28 +316,99 @@ bool DS9490::Write1W(uint8_t* buffer, uint length)
 
 bool DS9490::Reset1W()
 {
+   BusArbiter::Transaction transaction(&m_arbiter, BusArbiter::Normal);
    if (!DeviceOpen()) {
-      m_lastError = "Device not open";
+      m_error = DeviceError(DeviceError::NOT_OPEN);
       return false;
    }
-   int result = usb_control_msg(m_usbDevHandle, 0x40, COMM_CMD, 
-                                0x0043, 0, NULL, 0, m_timeout);
+   int result = ControlMessage(COMM_CMD, 0x0043, 0);
    if (result!=0) {
-      m_lastError = "Error writing USB command";
+      m_error = DeviceError(DeviceError::USB_COMMAND, result);
       return false;
    }
 
+   // the result of the reset follows the 16 byte state registers
+   m_resultCode = 0;
+   if (!WaitIdle())
+      return false;
+   m_devicePresent = !(m_resultCode & (RES_NRS|RES_SH));
+   
+   return true;
+}
+
+/**
+ * @brief Resets the bus and checks that a device answered
+ * 
+ * Fails with DeviceError::NO_PRESENCE or DeviceError::SHORTED if the reset found no device, so that operations
+ * on an empty bus cost one reset instead of running into CRC errors or timeouts.
+ */
+bool DS9490::ResetPresent()
+{
+   if (!Reset1W())
+      return false;
+   if (m_resultCode & RES_SH) {
+      m_error = DeviceError(DeviceError::SHORTED, 0, m_resultCode);
+      return false;
+   }
+   if (!m_devicePresent) {
+      m_error = DeviceError(DeviceError::NO_PRESENCE, 0, m_resultCode);
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Reads the status until the DS2490 is idle
+ * 
+ * The result codes following the 16 state registers are added to m_resultCode. A device detect code, which
+ * the DS2490 reports when a device is attached to the idle bus, is kept for GetDeviceAttached().
+ */
+bool DS9490::WaitIdle()
+{
    char buffer[32];
-   // read status until unit is idle
+   int result;
    do {
-      result = usb_bulk_read(m_usbDevHandle, 0x81, // EP1: control
-                             buffer, 0x20, m_timeout);
-   } while(!(buffer[0x08] & 0x20) && (result>=0));
+      result = BulkRead(0x81, buffer, 0x20);  // EP1: control
+      for (int i=16; i<result; i++) {
+         uint8_t code = buffer[i];
+         if (code==RES_DEVICE_DETECT)
+            m_deviceAttached = true;
+         else
+            m_resultCode |= code;
+      }
+   } while(result>=0 && !(buffer[0x08] & 0x20));
    if (result<0) {
-      m_lastError = "Error reading device status";
+      m_error = DeviceError(DeviceError::USB_STATUS, result);
       return false;
    }
-   
+   return true;
+}
+
+/**
+ * @brief Returns whether the DS2490 reported a newly attached device since the last call
+ */
+bool DS9490::GetDeviceAttached()
+{
+   bool attached = m_deviceAttached;
+   m_deviceAttached = false;
+   return attached;
+}
+
+/**
+ * @brief Checks whether a device is present on the 1-Wire bus
+ * 
+ * A 1-Wire reset is issued, and @p present is set according to the presence pulse reported by the DS2490.
+ * @p alarming, if given, is set if a device answered with an alarming presence pulse.
+ * @return bool: false if the adapter could not be accessed, e.g. because it was unplugged.
+ */
+bool DS9490::DetectPresence(bool& present, bool* alarming)
+{
+   BusArbiter::Transaction transaction(&m_arbiter, BusArbiter::Normal);
+   if (!Reset1W())
+      return false;
+   present = m_devicePresent;
+   if (alarming)
+      *alarming = m_devicePresent && (m_resultCode & RES_APP);
    return true;
 }
 
@@ -241,7 +423,7 @@ bool DS9490::WriteByte(uint8_t data)
    if (TouchByte(data, read))
    {
       if (read!=data) {
-         m_lastError = "WriteByte: read data != written data";
+         m_error = DeviceError(DeviceError::ECHO_MISMATCH, 0, read);
          return false;
       }
       return true;
@@ -251,29 +433,20 @@ bool DS9490::WriteByte(uint8_t data)
 
 bool DS9490::TouchByte(uint8_t write, uint8_t& read)
 {
-   int result = usb_control_msg(m_usbDevHandle, 0x40, COMM_CMD, 
-                                0x0053, write, NULL, 0, m_timeout);
+   int result = ControlMessage(COMM_CMD, 0x0053, write);
    if (result!=0) {
-      m_lastError = "Error writing USB command";
+      m_error = DeviceError(DeviceError::USB_COMMAND, result);
       return false;
    }
    
-   char buffer[32];
-   // read status until unit is idle
-   do {
-      result = usb_bulk_read(m_usbDevHandle, 0x81, // EP1: control
-                             buffer, 0x20, m_timeout);
-   } while(!(buffer[0x08] & 0x20) && (result>=0));
-   if (result<0) {
-      m_lastError = "Error reading device status";
+   if (!WaitIdle())
       return false;
-   }
   
    // read data
-   result = usb_bulk_read(m_usbDevHandle, 0x83, // EP3: bulk read
-                           buffer, 1, m_timeout);
+   char buffer[32];
+   result = BulkRead(0x83, buffer, 1);    // EP3: bulk read
    if (result<0) {
-      m_lastError = "Error reading data";
+      m_error = DeviceError(DeviceError::USB_DATA, result);
       return false;
    }
    read = buffer[0];
@@ -282,31 +455,89 @@ bool DS9490::TouchByte(uint8_t write, uint8_t& read)
 
 bool DS9490::TouchBit(uint8_t write, uint8_t& read)
 {
-    int result = usb_control_msg(m_usbDevHandle, 0x40, COMM_CMD, 
-                                0x0021|((write&1)<<3), 0, NULL, 0, m_timeout);
+   int result = ControlMessage(COMM_CMD, 0x0021|((write&1)<<3), 0);
    if (result!=0) {
-      m_lastError = "Error writing USB command";
+      m_error = DeviceError(DeviceError::USB_COMMAND, result);
       return false;
    }
    
-   char buffer[32];
-   // read status until unit is idle
-   do {
-      result = usb_bulk_read(m_usbDevHandle, 0x81, // EP1: control
-                             buffer, 0x20, m_timeout);
-   } while(!(buffer[0x08] & 0x20) && (result>=0));
-   if (result<0) {
-      m_lastError = "Error reading device status";
+   if (!WaitIdle())
       return false;
-   }
   
    // read data
-   result = usb_bulk_read(m_usbDevHandle, 0x83, // EP3: bulk read
-                           buffer, 1, m_timeout);
+   char buffer[32];
+   result = BulkRead(0x83, buffer, 1);    // EP3: bulk read
    if (result<0) {
-      m_lastError = "Error reading data";
+      m_error = DeviceError(DeviceError::USB_DATA, result);
       return false;
    }
    read = buffer[0];
    return true;  
 }
+
+/**
+ * @brief Sends a vendor control request to the DS2490, with a timeout adapted to the measured latency
+ */
+int DS9490::ControlMessage(int request, int value, int index)
+{
+   timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   int result = usb_control_msg(m_usbDevHandle, 0x40, request, value, index, NULL, 0, GetTimeout());
+   UpdateLatency(start, result);
+   return result;
+}
+
+/**
+ * @brief Reads from a DS2490 endpoint, with a timeout adapted to the measured latency
+ */
+int DS9490::BulkRead(int endpoint, char* buffer, int size)
+{
+   timespec start;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   int result = usb_bulk_read(m_usbDevHandle, endpoint, buffer, size, GetTimeout());
+   UpdateLatency(start, result);
+   return result;
+}
+
+/**
+ * @brief Returns the timeout for the next USB call in ms
+ * 
+ * As for TCP retransmissions, the timeout is the smoothed latency plus four times its mean deviation, limited
+ * to m_minTimeout and m_maxTimeout. Until the latency has been measured, m_maxTimeout is used.
+ */
+int DS9490::GetTimeout()
+{
+   if (m_latency<0)
+      return m_maxTimeout;
+   int timeout = (int)(m_latency + 4*m_latencyDeviation) + 1;
+   if (timeout<m_minTimeout)
+      return m_minTimeout;
+   if (timeout>m_maxTimeout)
+      return m_maxTimeout;
+   return timeout;
+}
+
+/**
+ * @brief Adds the duration of a USB call started at @p start to the latency estimate
+ * 
+ * A timeout discards the estimate, so the next calls wait up to m_maxTimeout again.
+ */
+void DS9490::UpdateLatency(const timespec& start, int result)
+{
+   if (result==-ETIMEDOUT) {
+      m_latency = -1;
+      return;
+   }
+   if (result<0)
+      return;
+   timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   double latency = (now.tv_sec-start.tv_sec)*1e3 + (now.tv_nsec-start.tv_nsec)/1e6;
+   if (m_latency<0) {
+      m_latency = latency;
+      m_latencyDeviation = latency/2;
+   } else {
+      m_latencyDeviation += (std::abs(latency-m_latency) - m_latencyDeviation)/4;
+      m_latency += (latency-m_latency)/8;
+   }
+}
@@ -23,13 +23,20 @@
 #include <string>
 #include <list>
 #include <usb.h>
+#include <ctime>
+#include "busarbiter.h"
+#include "deviceerror.h"
 
 /**
  * @brief Represents a Maxim DS9490 USB 1-Wire reader
  * 
  * This class handles the communication with the USB 1-Wire reader using libusb. It includes functions to scan for devices
  * on the 1-Wire bus, read from and write to the found devices, and reset the bus. On error, these functions return false,
- * and the error message can be retrieved using GetLastError().
+ * and the cause can be retrieved using GetError(), or as message using GetLastError().
+ * Operations that address a device fail right after the bus reset if no device answers it. The timeouts of the
+ * USB calls adapt to their measured latency, so a hanging adapter is detected quickly.
+ * Each of the public functions holds the bus arbiter for its duration. To make a sequence of calls atomic,
+ * e.g. a command and the following read, hold it using a BusArbiter::Transaction on GetArbiter().
  */
 class DS9490
 {
@@ -38,15 +45,34 @@ public:
    ~DS9490();
    
 public:
-   std::string GetLastError() {return m_lastError;}
-   bool OpenUsbDevice();
+   std::string GetLastError() {return m_error.ToString();}
+   const DeviceError& GetError() {return m_error;}
+   BusArbiter* GetArbiter() {return &m_arbiter;}
+   static int CountUsbDevices();
+   bool OpenUsbDevice(int index=0);
+   void CloseUsbDevice();
    bool DeviceOpen() {return m_usbDevHandle!=NULL;}
-   bool Scan1WBus(std::list<uint64_t>& serials);
+   bool DetectPresence(bool& present, bool* alarming=NULL);
+   bool GetDeviceAttached();
+   bool Scan1WBus(std::list<uint64_t>& serials, uint8_t family=0, bool alarmOnly=false);
    bool Read1W(uint8_t* buffer, uint length);
-   bool Write1W(uint8_t* buffer, uint length);
+   bool Write1W(uint8_t* buffer, uint length, uint64_t rom=0);
    bool Reset1W();
 protected:
    bool AquireUsb(struct usb_device* dev);
+   bool ResetPresent();
+   bool WaitIdle();
+   struct SearchState
+   {
+      uint64_t rom;              // ROM ID found by the last search
+      int lastDiscrepancy;       // bit number of the last 0 taken at a discrepancy, from 1
+      bool lastDevice;
+   };
+   bool SearchRom(SearchState& state, uint8_t command, bool& found);
+   int ControlMessage(int request, int value, int index);
+   int BulkRead(int endpoint, char* buffer, int size);
+   int GetTimeout();
+   void UpdateLatency(const timespec& start, int result);
    bool Release();
    bool ReadByte(uint8_t& read);
    bool WriteByte(uint8_t data);
@@ -55,8 +81,14 @@ protected:
    
    // Data
 private:
-   std::string m_lastError;
+   DeviceError m_error;
    usb_dev_handle* m_usbDevHandle;
+   bool m_devicePresent;   // presence pulse seen at last Reset1W()
+   uint8_t m_resultCode;   // RES_... flags reported for the last Reset1W()
+   bool m_deviceAttached;  // device detect reported, see GetDeviceAttached()
+   double m_latency;       // smoothed duration of a USB call in ms, <0 if unknown
+   double m_latencyDeviation;
+   BusArbiter m_arbiter;
    
    // codes from DS2490 datasheet
    enum Commands {CONTROL_CMD=0x00,COMM_CMD=0x01,MODE_CMD=0x02,
@@ -69,8 +101,12 @@ private:
          MOD_STRONG_PU_DURATION=0x03,MOD_PULLDOWN_SLEWRATE=0x04,
          MOD_PROG_PULSE_DURATION=0x05,MOD_WRITE1_LOWTIME=0x06,
          MOD_DSOW0_TREC=0x07};
+   enum Results {RES_DEVICE_DETECT=0xA5,RES_NRS=0x01,RES_SH=0x02,
+         RES_APP=0x04,RES_VPP=0x08,RES_CMP=0x10,RES_CRC=0x20,RES_RDP=0x40,
+         RES_EOS=0x80};
 
-   static const int m_timeout=5000;
+   static const int m_minTimeout=100;   // ms
+   static const int m_maxTimeout=5000;  // "
 };
 
 #endif // DS2490_H
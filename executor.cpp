@@ -0,0 +1,72 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "executor.h"
+
+
+Executor::Executor()
+{
+}
+
+Executor::~Executor()
+{
+   Clear();
+}
+
+/**
+ * @brief Adds @p task, which is deleted by the executor when it is finished
+ */
+void Executor::Post(Task* task)
+{
+   m_tasks.push_back(task);
+}
+
+/**
+ * @brief Advances every task by one step, and deletes the finished ones
+ * 
+ * Tasks posted during the round are first stepped in the next round.
+ * @return bool: true if tasks remain.
+ */
+bool Executor::RunOnce()
+{
+   size_t count = m_tasks.size();
+   std::list<Task*>::iterator it = m_tasks.begin();
+   for (size_t i=0; i<count; i++)
+   {
+      if ((*it)->Step()) {
+         ++it;
+      } else {
+         delete *it;
+         it = m_tasks.erase(it);
+      }
+   }
+   return !m_tasks.empty();
+}
+
+/**
+ * @brief Deletes all tasks without finishing them
+ */
+void Executor::Clear()
+{
+   for (std::list<Task*>::iterator it=m_tasks.begin(); it!=m_tasks.end(); ++it)
+   {
+      delete *it;
+   }
+   m_tasks.clear();
+}
@@ -0,0 +1,63 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+#include <list>
+#include <cstddef>
+
+/**
+ * @brief A resumable operation, e.g. the download of a logger
+ * 
+ * Step() performs the next short part of the operation, typically one bus transaction, and returns false once
+ * the operation is finished, successfully or not.
+ */
+class Task
+{
+public:
+   virtual ~Task() {}
+   virtual bool Step() = 0;
+};
+
+/**
+ * @brief Runs tasks cooperatively in the calling thread
+ * 
+ * Each RunOnce() advances every posted task by one step, in the order they were posted, so a long download
+ * on one adapter does not block the loggers on the other adapters, and the caller's event loop stays
+ * responsive between rounds. The number of threads stays the same however many tasks are running.
+ */
+class Executor
+{
+public:
+   Executor();
+   ~Executor();
+   
+public:
+   void Post(Task* task);
+   bool RunOnce();
+   void Clear();
+   bool IsIdle() {return m_tasks.empty();}
+   size_t GetTaskCount() {return m_tasks.size();}
+   
+   // Data
+private:
+   std::list<Task*> m_tasks;
+};
+
+#endif // EXECUTOR_H
@@ -0,0 +1,58 @@
+#include "datamodel.h"
+
+
+DataModel::DataModel(QObject *parent)
+ : QAbstractTableModel(parent)
+{
+   m_interval = 0;
+}
+
+/**
+ * @brief Replaces the samples shown
+ * 
+ * @p values are in chronological order, the first one taken at @p start, with @p interval seconds between them.
+ */
+void DataModel::SetSamples(const QVector<double>& values, const QDateTime& start, int interval)
+{
+   beginResetModel();
+   m_values = values;
+   m_start = start;
+   m_interval = interval;
+   endResetModel();
+}
+
+int DataModel::rowCount(const QModelIndex& parent) const
+{
+   if (parent.isValid())
+      return 0;
+   return m_values.size();
+}
+
+int DataModel::columnCount(const QModelIndex& parent) const
+{
+   if (parent.isValid())
+      return 0;
+   return 2;
+}
+
+QVariant DataModel::data(const QModelIndex& index, int role) const
+{
+   if (role!=Qt::DisplayRole || !index.isValid() || index.row()>=m_values.size())
+      return QVariant();
+   if (index.column()==0)
+      return m_locale.toString(GetTime(index.row()), QLocale::ShortFormat);
+   if (m_values[index.row()]!=m_values[index.row()])
+      return QString();   // not downloaded yet
+   return QString::number(m_values[index.row()]);
+}
+
+QVariant DataModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+   if (role!=Qt::DisplayRole)
+      return QVariant();
+   if (orientation==Qt::Vertical)
+      return section+1;
+   if (section==0)
+      return tr("Time");
+   return tr("Value [°C]");
+}
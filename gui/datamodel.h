@@ -0,0 +1,40 @@
+#ifndef DATAMODEL_H
+#define DATAMODEL_H
+
+#include <QAbstractTableModel>
+#include <QVector>
+#include <QDateTime>
+#include <QLocale>
+
+/**
+ * @brief Table model over the samples of a mission
+ * 
+ * Only the raw values are stored. The cell texts, timestamp and temperature, are formatted when a view
+ * requests them, so setting the data is independent of the number of samples.
+ */
+class DataModel : public QAbstractTableModel
+{
+   Q_OBJECT
+public:
+   DataModel(QObject *parent = 0);
+
+   void SetSamples(const QVector<double>& values, const QDateTime& start, int interval);
+   const QVector<double>& GetValues() const {return m_values;}
+   QDateTime GetStart() const {return m_start;}
+   int GetInterval() const {return m_interval;}
+   QDateTime GetTime(int row) const {return m_start.addSecs((qint64)row*m_interval);}
+
+   virtual int rowCount(const QModelIndex& parent = QModelIndex()) const;
+   virtual int columnCount(const QModelIndex& parent = QModelIndex()) const;
+   virtual QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+   virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+   // data
+private:
+   QVector<double> m_values;
+   QDateTime m_start;
+   int m_interval;      // seconds
+   QLocale m_locale;
+};
+
+#endif
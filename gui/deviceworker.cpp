@@ -0,0 +1,189 @@
+#include "deviceworker.h"
+#include "../ds1922.h"
+#include "../ds9490.h"
+#include "../livemonitor.h"
+#include <QElapsedTimer>
+#include <QThread>
+#include <algorithm>
+
+
+DeviceWorker::DeviceWorker(DS9490* ds9490, DS1922* ds1922)
+{
+   m_ds9490 = ds9490;
+   m_ds1922 = ds1922;
+   m_cancel = false;
+   m_ds1922->SetProgressHandler([this](int done, int total) {
+      emit progress(done, total);
+      return !m_cancel;
+   });
+}
+
+bool DeviceWorker::OpenDevice()
+{
+   if (!m_ds9490->DeviceOpen())
+      if (!m_ds9490->OpenUsbDevice()) {
+         emit failed(tr("Error opening USB device:\n")+m_ds9490->GetLastError().c_str());
+         return false;
+      }
+   return true;
+}
+
+/**
+ * @brief Prepares an operation: resets the cancel flag and opens the device
+ */
+bool DeviceWorker::Start()
+{
+   m_cancel = false;
+   return OpenDevice();
+}
+
+void DeviceWorker::readConfig()
+{
+   if (!Start())
+      return;
+   if (!m_ds1922->ReadRegister()) {
+      emit failed(tr("Error reading config:\n")+m_ds1922->GetLastError().c_str());
+      return;
+   }
+   emit configRead();
+}
+
+/**
+ * @brief Reads the configuration and all available samples of the mission
+ * 
+ * With rollover, only the newest samples are available. The number of the first sample within the mission
+ * is passed with dataRead(). The samples are read coarse first, see DS1922::ReadSamplesProgressive(), and
+ * the partial data is passed with dataRefined() as it arrives.
+ */
+void DeviceWorker::readData()
+{
+   if (!Start())
+      return;
+   if (!m_ds1922->ReadRegister()) {
+      emit failed(tr("Error reading config:\n")+m_ds1922->GetLastError().c_str());
+      return;
+   }
+   int sampleCount = m_ds1922->GetSampleCount();
+   int firstSample = sampleCount - m_ds1922->GetLogCapacity();
+   if (firstSample<0)
+      firstSample = 0;
+   QVector<double> values(sampleCount-firstSample);
+   double* buffer = values.data();
+   auto refined = [&](int pages, int totalPages) {
+      if (pages<totalPages) {
+         // a deep copy, the buffer is still being written
+         QVector<double> preview(values.size());
+         std::copy(buffer, buffer+values.size(), preview.data());
+         emit dataRefined(firstSample, preview);
+      }
+      return !m_cancel;
+   };
+   if (!m_ds1922->ReadSamplesProgressive(buffer, firstSample, values.size(), refined)) {
+      emit failed(tr("Error reading data:\n")+m_ds1922->GetLastError().c_str());
+      return;
+   }
+   emit dataRead(firstSample, values);
+}
+
+void DeviceWorker::writeConfig()
+{
+   if (!Start())
+      return;
+   if (!m_ds1922->WriteRegister()) {
+      emit failed(tr("Error writing config:\n")+m_ds1922->GetLastError().c_str());
+      return;
+   }
+   readConfig();
+}
+
+void DeviceWorker::stopMission()
+{
+   if (!Start())
+      return;
+   if (!m_ds1922->StopMission()) {
+      emit failed(tr("Error stopping mission:\n")+m_ds1922->GetLastError().c_str());
+      return;
+   }
+   readConfig();
+}
+
+void DeviceWorker::clearData()
+{
+   if (!Start())
+      return;
+   if (!m_ds1922->ClearMemory()) {
+      emit failed(tr("Error clearing memory:\n")+m_ds1922->GetLastError().c_str());
+      return;
+   }
+   readConfig();
+}
+
+void DeviceWorker::startMission()
+{
+   if (!Start())
+      return;
+   if (!m_ds1922->ClearMemory() || !m_ds1922->StartMission()) {
+      emit failed(tr("Error starting mission:\n")+m_ds1922->GetLastError().c_str());
+      return;
+   }
+   readConfig();
+}
+
+/**
+ * @brief Sets the clock of the device to the system time, see DS1922::SyncRtc()
+ */
+void DeviceWorker::syncRtc()
+{
+   if (!Start())
+      return;
+   double skew;
+   if (!m_ds1922->ReadRegister() || !m_ds1922->SyncRtc(&skew)) {
+      emit failed(tr("Error setting clock:\n")+m_ds1922->GetLastError().c_str());
+      return;
+   }
+   emit rtcSynced(skew);
+   readConfig();
+}
+
+/**
+ * @brief Reads the current temperature of all loggers on the bus every @p interval seconds until cancelled
+ * 
+ * Uses forced conversions, see LiveMonitor, so only loggers without a mission in progress take part. Each
+ * reading is passed with liveReading(), liveStopped() is emitted when cancelled.
+ */
+void DeviceWorker::runLive(int interval)
+{
+   if (!Start())
+      return;
+   LiveMonitor monitor;
+   if (!monitor.AddBus(m_ds9490)) {
+      emit failed(tr("Error searching bus:\n")+monitor.GetLastError().c_str());
+      return;
+   }
+   if (monitor.GetLoggerCount()==0) {
+      emit failed(tr("No logger without mission found"));
+      return;
+   }
+   QElapsedTimer timer;
+   timer.start();
+   qint64 next = 0;
+   std::vector<LiveMonitor::Reading> readings;
+   while (!m_cancel) {
+      monitor.Poll(readings);
+      int errors = 0;
+      for (size_t i=0; i<readings.size(); i++) {
+         if (readings[i].error.code==DeviceError::NONE)
+            emit liveReading(readings[i].rom, readings[i].time, readings[i].temperature);
+         else
+            errors++;
+      }
+      if (errors==(int)readings.size()) {
+         emit failed(tr("Error reading temperature:\n")+readings[0].error.ToString().c_str());
+         return;
+      }
+      next += interval*1000;
+      while (!m_cancel && timer.elapsed()<next)
+         QThread::msleep(20);
+   }
+   emit liveStopped();
+}
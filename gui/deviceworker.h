@@ -0,0 +1,57 @@
+#ifndef DEVICEWORKER_H
+#define DEVICEWORKER_H
+
+#include <QObject>
+#include <QVector>
+#include <QString>
+#include <atomic>
+
+class DS1922;
+class DS9490;
+
+/**
+ * @brief Runs the USB communication with the DS1922 in a background thread
+ * 
+ * The object is moved to a worker thread, and its slots are invoked through queued connections. Results are
+ * reported by signals. While an operation is running, the DS1922 and DS9490 objects must not be used by other
+ * threads; after configRead(), dataRead() or failed() was received, they can be accessed again.
+ */
+class DeviceWorker : public QObject
+{
+   Q_OBJECT
+public:
+   DeviceWorker(DS9490* ds9490, DS1922* ds1922);
+   void Cancel() {m_cancel = true;}
+
+public slots:
+   void readConfig();
+   void readData();
+   void writeConfig();
+   void stopMission();
+   void clearData();
+   void startMission();
+   void syncRtc();
+   void runLive(int interval);
+
+signals:
+   void progress(int pages, int totalPages);
+   void configRead();
+   void dataRead(int firstSample, QVector<double> values);
+   void dataRefined(int firstSample, QVector<double> values);
+   void failed(QString message);
+   void rtcSynced(double skew);
+   void liveReading(quint64 rom, double time, double temperature);
+   void liveStopped();
+
+private:
+   bool OpenDevice();
+   bool Start();
+
+   // data
+private:
+   DS9490* m_ds9490;
+   DS1922* m_ds1922;
+   std::atomic<bool> m_cancel;
+};
+
+#endif
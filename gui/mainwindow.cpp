@@ -1,14 +1,22 @@
 #include "mainwindow.h"
 #include "../ds1922.h"
 #include "../ds9490.h"
+#include "../presencewatcher.h"
+#include "../csvexporter.h"
+#include "../missionstatistics.h"
+#include "deviceworker.h"
+#include "datamodel.h"
+#include "plotwidget.h"
 #include <QMessageBox>
 #include <QClipboard>
 #include <QFileDialog>
-#include <QTextStream>
-#include <QProcess>
-#include <QTemporaryFile>
+#include <QFile>
 #include <QLocale>
 #include <QString>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QHeaderView>
+#include <QInputDialog>
 #include "ui_about.h"
 #include <string>
 //#include <iostream>
@@ -20,27 +28,108 @@ MainWindow::MainWindow(QWidget *parent)
    rtcEdit->setDisplayFormat(QLocale::system().dateFormat(QLocale::ShortFormat)+" HH:mm:ss");
    m_ds9490 = new DS9490;
    m_ds1922 = new DS1922(m_ds9490);
+   m_ds1922->SetPriority(BusArbiter::Interactive);
+   m_watcher = new PresenceWatcher(m_ds9490);
+   m_watchTimer = new QTimer(this);
+   connect(m_watchTimer, SIGNAL(timeout()), this, SLOT(onWatchTimer()));
+   m_autoReadPending = false;
+   m_busy = false;
+   m_live = false;
+   m_liveInterval = 1;
+   
+   m_plotWidget = NULL;
+   m_dataModel = new DataModel(this);
+   dataTable->setModel(m_dataModel);
+   dataTable->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+   
+   m_progressBar = new QProgressBar(this);
+   m_progressBar->setMaximumWidth(200);
+   m_progressBar->hide();
+   statusbar->addPermanentWidget(m_progressBar);
+   m_cancelButton = new QPushButton(tr("Cancel"), this);
+   m_cancelButton->hide();
+   statusbar->addPermanentWidget(m_cancelButton);
+   connect(m_cancelButton, SIGNAL(clicked()), this, SLOT(onCancel()));
+   
+   // all USB communication runs in the worker thread
+   qRegisterMetaType<QVector<double> >("QVector<double>");
+   m_worker = new DeviceWorker(m_ds9490, m_ds1922);
+   m_worker->moveToThread(&m_workerThread);
+   connect(m_worker, SIGNAL(configRead()), this, SLOT(onConfigRead()));
+   connect(m_worker, SIGNAL(dataRead(int, QVector<double>)), this, SLOT(onDataRead(int, QVector<double>)));
+   connect(m_worker, SIGNAL(dataRefined(int, QVector<double>)),
+           this, SLOT(onDataRefined(int, QVector<double>)));
+   connect(m_worker, SIGNAL(failed(QString)), this, SLOT(onFailed(QString)));
+   connect(m_worker, SIGNAL(rtcSynced(double)), this, SLOT(onRtcSynced(double)));
+   connect(m_worker, SIGNAL(progress(int, int)), this, SLOT(onProgress(int, int)));
+   connect(m_worker, SIGNAL(liveReading(quint64, double, double)),
+           this, SLOT(onLiveReading(quint64, double, double)));
+   connect(m_worker, SIGNAL(liveStopped()), this, SLOT(onLiveStopped()));
+   m_workerThread.start();
 }
 
 
 MainWindow::~MainWindow()
 {
+   m_worker->Cancel();
+   m_workerThread.quit();
+   m_workerThread.wait();
+   delete m_worker;
+   delete m_watcher;
    delete m_ds1922;
    delete m_ds9490;
 }
 
-void MainWindow::onReadConfig()
+/**
+ * @brief Starts an operation of the worker, unless one is already running
+ */
+void MainWindow::RunOperation(const char* slot)
 {
-   if (!m_ds9490->DeviceOpen())
-      if (!m_ds9490->OpenUsbDevice()) {
-         QMessageBox::critical(this, "Error", tr("Error opening USB device:\n")+m_ds9490->GetLastError().c_str());
-         return;
-      }
-      
-   if (!m_ds1922->ReadRegister()) {
-     QMessageBox::critical(this, "Error", tr("Error reading config:\n")+m_ds1922->GetLastError().c_str());
-     return;
+   if (m_busy)
+      return;
+   SetBusy(true);
+   QMetaObject::invokeMethod(m_worker, slot, Qt::QueuedConnection);
+}
+
+void MainWindow::SetBusy(bool busy)
+{
+   m_busy = busy;
+   menuDevice->setEnabled(!busy);
+   m_progressBar->setVisible(busy);
+   m_progressBar->setRange(0, 0);   // busy indicator until progress is known
+   m_cancelButton->setVisible(busy);
+}
+
+void MainWindow::onProgress(int pages, int totalPages)
+{
+   m_progressBar->setRange(0, totalPages);
+   m_progressBar->setValue(pages);
+}
+
+void MainWindow::onCancel()
+{
+   m_worker->Cancel();
+}
+
+void MainWindow::onFailed(QString message)
+{
+   SetBusy(false);
+   if (m_live) {
+      m_live = false;
+      actionLive->setChecked(false);
    }
+   QMessageBox::critical(this, "Error", message);
+   AutoReadFinished(false);
+}
+
+void MainWindow::onReadConfig()
+{
+   RunOperation("readConfig");
+}
+
+void MainWindow::onConfigRead()
+{
+   SetBusy(false);
    // set all config settings 
    tm rtc;
    m_ds1922->GetRtc(&rtc);
@@ -106,50 +195,86 @@ void MainWindow::onReadConfig()
 
 void MainWindow::onReadData()
 {  
-   onReadConfig();
-   
-   int sampleCount=m_ds1922->GetSampleCount();
+   RunOperation("readData");
+}
+
+/**
+ * @brief Shows the downloaded samples
+ * 
+ * @p firstSample is the number of the first value within the mission, which is not 0 if older samples
+ * were overwritten due to rollover.
+ */
+void MainWindow::onDataRead(int firstSample, QVector<double> values)
+{
+   onConfigRead();
+   ShowSamples(firstSample, values);
+   AutoReadFinished(true);
+}
+
+/**
+ * @brief Shows the samples read so far, while the download continues
+ * 
+ * Missing samples are NaN. The statistics are estimated from the samples read, and an open plot window
+ * shows the partial mission, which is refined in place.
+ */
+void MainWindow::onDataRefined(int firstSample, QVector<double> values)
+{
+   if (!m_busy)
+      return;   // late signal of a cancelled download
+   ShowSamples(firstSample, values);
+}
+
+void MainWindow::ShowSamples(int firstSample, const QVector<double>& values)
+{
    int sampleRate=m_ds1922->GetSampleRate();
-   int maxMissionSamples = (m_ds1922->GetHighResLogging() ? 4096 : 8192);
-   int posOldestValue = sampleCount % maxMissionSamples;
-   
-   tm timeStampValue;
-   m_ds1922->GetMissionTimestamp(&timeStampValue);
-   QDateTime timeStamp = TmToDateTime(&timeStampValue);
-   
-   if (sampleCount>maxMissionSamples) {
-      timeStamp = timeStamp.addSecs(sampleRate*(sampleCount-maxMissionSamples));
-      sampleCount = maxMissionSamples;
-   } else {
-      posOldestValue = 0;
-   }
-   
-   double buffer[sampleCount];
-   if (!m_ds1922->ReadData(buffer, sampleCount)) {
-     QMessageBox::critical(this, "Error", tr("Error reading data:\n")+m_ds1922->GetLastError().c_str());
-     return;
-   }
-   
    if (!m_ds1922->GetHighspeedSampling()) {
      sampleRate=sampleRate*60;
    }
    
-   dataTable->setRowCount(sampleCount);
+   tm timeStampValue;
+   m_ds1922->GetMissionTimestamp(&timeStampValue);
+   QDateTime timeStamp = TmToDateTime(&timeStampValue).addSecs((qint64)sampleRate*firstSample);
    
-   for(int i = 0; i < sampleCount; i++) {
-       QDateTime addedTime = timeStamp.addSecs(i * sampleRate);
-       QString dateLocaleTime = QLocale().toString(addedTime, QLocale::ShortFormat);
-       QTableWidgetItem *time = new QTableWidgetItem(dateLocaleTime);
-
-       QTableWidgetItem *temperature = new QTableWidgetItem(QString::number(buffer[(i + posOldestValue) % maxMissionSamples]));
+   m_dataModel->SetSamples(values, timeStamp, sampleRate);
+   ShowStatistics(values);
+   if (m_plotWidget && m_plotWidget->isVisible()) {
+      QString name = QLocale().toString(timeStamp, QLocale::ShortFormat);
+      if (!m_plotWidget->SetSeriesValues(name, values))
+         m_plotWidget->AddSeries(name, values, timeStamp.toMSecsSinceEpoch()/1000, sampleRate);
+   }
+}
 
-       dataTable->setItem(i, 0, time);
-       dataTable->setItem(i, 1, temperature);
-   }   
+/**
+ * @brief Shows the statistics of @p values, using the alarm thresholds of the device
+ */
+void MainWindow::ShowStatistics(const QVector<double>& values)
+{
+   MissionStatistics statistics;
+   statistics.Compute(*m_ds1922, values.constData(), values.size());
+   if (statistics.GetCount()==0) {
+      statisticsLabel->clear();
+      return;
+   }
+   QLocale locale;
+   QString text = tr("Min: %1 °C, max: %2 °C, mean: %3 °C, MKT: %4 °C")
+      .arg(locale.toString(statistics.GetMin()))
+      .arg(locale.toString(statistics.GetMax()))
+      .arg(locale.toString(statistics.GetMean(), 'f', 2))
+      .arg(locale.toString(statistics.GetMeanKinetic(), 'f', 2));
+   text += "\n" + tr("Below %1 °C: %2 min in %3 excursions, above %4 °C: %5 min in %6 excursions")
+      .arg(locale.toString(statistics.GetLowThreshold()))
+      .arg(statistics.GetTimeBelow()/60)
+      .arg(statistics.GetExcursionsBelow())
+      .arg(locale.toString(statistics.GetHighThreshold()))
+      .arg(statistics.GetTimeAbove()/60)
+      .arg(statistics.GetExcursionsAbove());
+   statisticsLabel->setText(text);
 }
 
 void MainWindow::onWriteConfig()
 {
+   if (m_busy)
+      return;
    tm rtc;
    m_ds1922->GetRtc(&rtc);
    if (rtcEdit->dateTime() != TmToDateTime(&rtc)) {
@@ -177,52 +302,47 @@ void MainWindow::onWriteConfig()
    
    m_ds1922->SetLoggingEnabled(loggingCheckBox->isChecked());
    
-   if (!m_ds1922->WriteRegister()) {
-     QMessageBox::critical(this, "Error", tr("Error writing config:\n")+m_ds1922->GetLastError().c_str());
-     return;
-   }  
-   
-   onReadConfig();
+   RunOperation("writeConfig");
+}
+
+/**
+ * @brief Sets the clock of the device to the system time, compensating the latency of the adapter
+ */
+void MainWindow::onSyncRtc()
+{
+   RunOperation("syncRtc");
+}
+
+void MainWindow::onRtcSynced(double skew)
+{
+   statusbar->showMessage(tr("Clock synchronized, deviation %1 s").arg(skew, 0, 'f', 3), 10000);
 }
 
 void MainWindow::onStopMission()
 {
-   if (!m_ds1922->StopMission()) {
-     QMessageBox::critical(this, "Error", tr("Error stopping mission:\n")+m_ds1922->GetLastError().c_str());
-   } else {
-      onReadConfig();
-   }
+   RunOperation("stopMission");
 }
 
 void MainWindow::onClearData()
 {
-   if (!m_ds1922->ClearMemory()) {
-     QMessageBox::critical(this, "Error", tr("Error clearing memory:\n")+m_ds1922->GetLastError().c_str());
-   } else {
-      onReadConfig();
-   }
+   RunOperation("clearData");
 }
 
 void MainWindow::onStartMission()
 {
-   if (!m_ds1922->ClearMemory() || !m_ds1922->StartMission()) {
-     QMessageBox::critical(this, "Error", tr("Error starting mission:\n")+m_ds1922->GetLastError().c_str());
-   } else {
-      onReadConfig();
-   }
+   RunOperation("startMission");
 }
 
 
 QString MainWindow::GetDataAsCsv()
 {
-   QString data;
-   for (int i=0; i<dataTable->rowCount(); i++) {
-      data += dataTable->item(i, 0)->text();
-      data += "\t";
-      data += dataTable->item(i, 1)->text();
-      data += "\n";
-     }
-   return data;
+   std::string data;
+   const QVector<double>& values = m_dataModel->GetValues();
+   CsvExporter exporter(&data);
+   exporter.Write(values.constData(), values.size(), m_dataModel->GetStart().toMSecsSinceEpoch()/1000,
+                  m_dataModel->GetInterval());
+   exporter.Flush();
+   return QString::fromStdString(data);
 }
 
 void MainWindow::onCopy()
@@ -241,8 +361,13 @@ void MainWindow::onSafe()
       QFile file(fileName);
       if (file.open(QIODevice::WriteOnly))
       {
-         QTextStream out(&file);
-         out << GetDataAsCsv();
+         const QVector<double>& values = m_dataModel->GetValues();
+         CsvExporter exporter(file.handle());
+         if (!exporter.Write(values.constData(), values.size(), m_dataModel->GetStart().toMSecsSinceEpoch()/1000,
+                             m_dataModel->GetInterval()) || !exporter.Flush())
+         {
+            QMessageBox::critical(this, tr("Error"), tr("Error writing file:\n")+exporter.GetLastError().c_str());
+         }
       }
       else
       {
@@ -251,41 +376,133 @@ void MainWindow::onSafe()
    }
 }
 
+/**
+ * @brief Adds the current data to the plot window
+ * 
+ * The plot window is kept open, so several missions can be compared by reading and plotting one after another.
+ * A mission already shown is updated instead of added again.
+ */
 void MainWindow::onPlot()
 {
-   // Plot with gnuplot
-   QTemporaryFile dataFile;
-   QTemporaryFile scriptFile;
+   if (m_dataModel->GetValues().isEmpty())
+      return;
+   ShowPlotWidget();
+   QDateTime start = m_dataModel->GetStart();
+   QString name = QLocale().toString(start, QLocale::ShortFormat);
+   if (!m_plotWidget->SetSeriesValues(name, m_dataModel->GetValues()))
+      m_plotWidget->AddSeries(name, m_dataModel->GetValues(), start.toMSecsSinceEpoch()/1000,
+                              m_dataModel->GetInterval());
+}
+
+void MainWindow::ShowPlotWidget()
+{
+   if (!m_plotWidget) {
+      m_plotWidget = new PlotWidget(this);
+      m_plotWidget->setWindowFlags(Qt::Window);
+      m_plotWidget->resize(800, 500);
+   }
+   m_plotWidget->show();
+   m_plotWidget->raise();
+}
 
-   QString date=QLocale::system().dateFormat(QLocale::ShortFormat);
-   QString time="%H:%M:%S";
-   date.replace("dd","%d");
-   date.replace("MM","%m");
-   date.replace("yy","%y");
+/**
+ * @brief Starts or stops live temperature readings of the loggers without mission
+ * 
+ * The readings are added to the plot window as one scrolling series per logger.
+ */
+void MainWindow::onLive(bool enabled)
+{
+   if (!enabled) {
+      if (m_live)
+         m_worker->Cancel();
+      return;
+   }
+   if (m_live)
+      return;
+   bool ok = false;
+   int interval = 0;
+   if (!m_busy)
+      interval = QInputDialog::getInt(this, tr("Live Temperature"), tr("Interval in seconds:"),
+                                      m_liveInterval, 1, 3600, 1, &ok);
+   if (!ok) {
+      actionLive->setChecked(false);
+      return;
+   }
+   m_liveInterval = interval;
+   m_live = true;
+   ShowPlotWidget();
+   SetBusy(true);
+   QMetaObject::invokeMethod(m_worker, "runLive", Qt::QueuedConnection, Q_ARG(int, m_liveInterval));
+}
 
-   if (dataFile.open() && scriptFile.open()) 
-   {
-      dataFile.setAutoRemove(false);
-      scriptFile.setAutoRemove(false);
-      QTextStream out(&dataFile);
-      QString data = GetDataAsCsv();
-      data.replace(" ", "_");
-      out << data;
-      QTextStream scriptOut(&scriptFile);
-      scriptOut   << "set xdata time\n"
-                  << "set timefmt" << " " << "\"" << date << "_" << time <<"\"\n" 
-                  << "set grid\n"
-                  << "plot '" << dataFile.fileName() << "' u 1:2 title \"Temperature\" with linespoints lt 4 lw 2\n" 
-                  << "pause -1\n";
-      QProcess *gnuplot = new QProcess();
-      QStringList arguments(scriptFile.fileName());
-      arguments << "-";
-      gnuplot->start("gnuplot", arguments);
-      gnuplot->waitForStarted();
-//    gnuplot->close();
+void MainWindow::onLiveReading(quint64 rom, double time, double temperature)
+{
+   QString name = QString("%1").arg(rom, 16, 16, QChar('0'));
+   m_plotWidget->AppendValue(name, time, temperature, m_liveInterval);
+   statusbar->showMessage(tr("%1: %2 °C").arg(name).arg(temperature, 0, 'f', 2));
+}
+
+void MainWindow::onLiveStopped()
+{
+   SetBusy(false);
+   m_live = false;
+   actionLive->setChecked(false);
+   statusbar->clearMessage();
+}
+
+void MainWindow::onAutoRead(bool enabled)
+{
+   if (enabled) {
+      statusbar->showMessage(tr("Waiting for iButton..."));
+      m_watchTimer->start(100);
+   } else {
+      m_watchTimer->stop();
+      statusbar->clearMessage();
    }
 }
 
+void MainWindow::onWatchTimer()
+{
+   if (m_busy)
+      return;   // the bus is in use, check again later
+   switch (m_watcher->Poll()) {
+      case PresenceWatcher::AdapterAttached:
+         statusbar->showMessage(tr("Adapter attached, waiting for iButton..."));
+         break;
+      case PresenceWatcher::AdapterDetached:
+         statusbar->showMessage(tr("Adapter removed"));
+         break;
+      case PresenceWatcher::DeviceArrived:
+         m_watchTimer->stop();   // no polling while reading
+         m_autoReadPending = true;
+         m_autoReadTimer.start();
+         statusbar->showMessage(tr("iButton detected, reading..."));
+         onReadData();
+         break;
+      case PresenceWatcher::DeviceDeparted:
+         statusbar->showMessage(tr("iButton removed, waiting for iButton..."));
+         break;
+      case PresenceWatcher::NoEvent:
+         break;
+   }
+}
+
+/**
+ * @brief Reports the end of a readout started by the presence watcher and resumes watching
+ */
+void MainWindow::AutoReadFinished(bool ok)
+{
+   if (!m_autoReadPending)
+      return;
+   m_autoReadPending = false;
+   if (ok)
+      statusbar->showMessage(tr("Readout finished in %1 ms").arg(m_autoReadTimer.elapsed()));
+   else
+      statusbar->showMessage(tr("Readout failed"));
+   if (actionAutoRead->isChecked())
+      m_watchTimer->start();
+}
+
 void MainWindow::onAbout()
 {
    Ui_AboutDialog aboutDlg;
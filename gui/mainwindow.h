@@ -2,12 +2,21 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QThread>
+#include <QVector>
+#include <QElapsedTimer>
 #include <qtimer.h>
 #include "ui_main.h"
 
 
 class DS1922;
 class DS9490;
+class PresenceWatcher;
+class DeviceWorker;
+class DataModel;
+class PlotWidget;
+class QProgressBar;
+class QPushButton;
 
 class MainWindow : public QMainWindow, private Ui::MainWindow
 {
@@ -20,6 +29,8 @@ public slots:
    virtual void onReadConfig();
    virtual void onReadData();
    virtual void onWriteConfig();
+   virtual void onSyncRtc();
+   virtual void onRtcSynced(double skew);
    virtual void onStopMission();
    virtual void onClearData();
    virtual void onStartMission();
@@ -27,8 +38,25 @@ public slots:
    virtual void onSafe();
    virtual void onPlot();
    virtual void onAbout();
+   virtual void onAutoRead(bool enabled);
+   virtual void onLive(bool enabled);
+   virtual void onLiveReading(quint64 rom, double time, double temperature);
+   virtual void onLiveStopped();
+   virtual void onWatchTimer();
+   virtual void onConfigRead();
+   virtual void onDataRead(int firstSample, QVector<double> values);
+   virtual void onDataRefined(int firstSample, QVector<double> values);
+   virtual void onFailed(QString message);
+   virtual void onProgress(int pages, int totalPages);
+   virtual void onCancel();
    
 private:
+   void RunOperation(const char* slot);
+   void SetBusy(bool busy);
+   void AutoReadFinished(bool ok);
+   void ShowSamples(int firstSample, const QVector<double>& values);
+   void ShowStatistics(const QVector<double>& values);
+   void ShowPlotWidget();
    QString GetDataAsCsv();
    QDateTime TmToDateTime(tm* time);
    void DateTimeToTm(QDateTime dateTime, tm* time);
@@ -37,6 +65,19 @@ private:
 protected:
    DS1922* m_ds1922;
    DS9490* m_ds9490;
+   PresenceWatcher* m_watcher;
+   QTimer* m_watchTimer;
+   QElapsedTimer m_autoReadTimer;
+   bool m_autoReadPending;
+   QThread m_workerThread;
+   DeviceWorker* m_worker;
+   bool m_busy;
+   QProgressBar* m_progressBar;
+   QPushButton* m_cancelButton;
+   DataModel* m_dataModel;
+   PlotWidget* m_plotWidget;
+   bool m_live;         // live temperature readings are running
+   int m_liveInterval;  // seconds
 };
 
 #endif
@@ -0,0 +1,363 @@
+#include "plotwidget.h"
+#include <QPainter>
+#include <QWheelEvent>
+#include <QMouseEvent>
+#include <QContextMenuEvent>
+#include <QMenu>
+#include <QDateTime>
+#include <QLocale>
+#include <cmath>
+#include <limits>
+
+
+PlotWidget::PlotWidget(QWidget *parent)
+ : QWidget(parent)
+{
+   m_viewStart = 0;
+   m_viewEnd = 1;
+   m_dragViewStart = 0;
+   m_follow = true;
+   setMinimumSize(400, 250);
+   setWindowTitle(tr("Temperature"));
+}
+
+/**
+ * @brief Adds a mission to the plot
+ * 
+ * @p values are in chronological order, the first one taken at @p start (seconds since epoch), with
+ * @p interval seconds between them.
+ */
+void PlotWidget::AddSeries(const QString& name, const QVector<double>& values, qint64 start, int interval)
+{
+   static const QColor colors[] = {Qt::blue, Qt::red, Qt::darkGreen, Qt::magenta, Qt::darkCyan,
+      Qt::darkYellow, Qt::black, Qt::darkRed};
+   Series series;
+   series.name = name;
+   series.values = values;
+   series.start = start;
+   series.interval = interval;
+   series.color = colors[m_series.size() % (sizeof(colors)/sizeof(colors[0]))];
+   m_series.append(series);
+   ResetZoom();
+}
+
+/**
+ * @brief Appends a live value taken at @p time (seconds since epoch) to the series @p name
+ * 
+ * The series is created with the first value. Values are placed on a grid of @p interval seconds, missed
+ * ones are left as gaps. Unless the user zoomed or moved the view, it scrolls along with the newest values.
+ */
+void PlotWidget::AppendValue(const QString& name, double time, double value, int interval)
+{
+   int s = 0;
+   while (s<m_series.size() && (m_series[s].name!=name || m_series[s].interval!=interval))
+      s++;
+   if (s==m_series.size())
+      AddSeries(name, QVector<double>(), (qint64)std::floor(time), interval);
+   Series& series = m_series[s];
+   int index = qRound((time-series.start)/interval);
+   if (index<0)
+      return;
+   while (series.values.size()<=index)
+      series.values.append(std::numeric_limits<double>::quiet_NaN());
+   series.values[index] = value;
+   if (m_follow) {
+      ResetZoom();
+      if (m_viewEnd-m_viewStart>m_liveWindow)
+         m_viewStart = m_viewEnd-m_liveWindow;
+   } else {
+      update();
+   }
+}
+
+/**
+ * @brief Replaces the values of the series @p name, e.g. with a more complete download of the same mission
+ * 
+ * @return bool: false if there is no such series.
+ */
+bool PlotWidget::SetSeriesValues(const QString& name, const QVector<double>& values)
+{
+   for (int i=0; i<m_series.size(); i++) {
+      if (m_series[i].name==name) {
+         m_series[i].values = values;
+         if (m_follow)
+            ResetZoom();
+         else
+            update();
+         return true;
+      }
+   }
+   return false;
+}
+
+void PlotWidget::Clear()
+{
+   m_series.clear();
+   ResetZoom();
+}
+
+/**
+ * @brief Shows the complete time range of all missions
+ */
+void PlotWidget::ResetZoom()
+{
+   bool first = true;
+   for (int i=0; i<m_series.size(); i++) {
+      const Series& series = m_series[i];
+      if (series.values.isEmpty())
+         continue;
+      double end = series.start + (double)(series.values.size()-1)*series.interval;
+      if (first || series.start<m_viewStart)
+         m_viewStart = series.start;
+      if (first || end>m_viewEnd)
+         m_viewEnd = end;
+      first = false;
+   }
+   if (first) {
+      m_viewStart = 0;
+      m_viewEnd = 1;
+   }
+   if (m_viewEnd-m_viewStart<10) {
+      m_viewStart -= 5;
+      m_viewEnd += 5;
+   }
+   m_follow = true;
+   update();
+}
+
+QRect PlotWidget::PlotArea() const
+{
+   return rect().adjusted(60, 10, -15, -40);
+}
+
+/**
+ * @brief Determines the value range of the samples in the visible time range
+ * 
+ * @return bool: false if no sample is visible.
+ */
+bool PlotWidget::GetValueRange(double& minValue, double& maxValue) const
+{
+   minValue = std::numeric_limits<double>::infinity();
+   maxValue = -minValue;
+   for (int s=0; s<m_series.size(); s++) {
+      const Series& series = m_series[s];
+      if (series.interval<=0)
+         continue;
+      int first = std::max(0, (int)std::floor((m_viewStart-series.start)/series.interval));
+      int last = std::min(series.values.size()-1, (int)std::ceil((m_viewEnd-series.start)/series.interval));
+      for (int i=first; i<=last; i++) {
+         double value = series.values[i];
+         if (value<minValue)
+            minValue = value;
+         if (value>maxValue)
+            maxValue = value;
+      }
+   }
+   if (minValue>maxValue)
+      return false;
+   double margin = (maxValue-minValue)*0.05;
+   if (margin<0.5)
+      margin = 0.5;
+   minValue -= margin;
+   maxValue += margin;
+   return true;
+}
+
+void PlotWidget::paintEvent(QPaintEvent*)
+{
+   QPainter painter(this);
+   painter.fillRect(rect(), palette().base());
+   QRect area = PlotArea();
+   double minValue, maxValue;
+   if (area.width()<=0 || area.height()<=0 || !GetValueRange(minValue, maxValue)) {
+      painter.drawText(rect(), Qt::AlignCenter, tr("No data"));
+      return;
+   }
+   DrawAxes(painter, area, minValue, maxValue);
+   
+   painter.save();
+   painter.setClipRect(area);
+   painter.setRenderHint(QPainter::Antialiasing);
+   for (int i=0; i<m_series.size(); i++) {
+      DrawSeries(painter, m_series[i], area, minValue, maxValue);
+   }
+   painter.restore();
+   
+   // legend
+   int y = area.top() + painter.fontMetrics().height();
+   for (int i=0; i<m_series.size(); i++) {
+      painter.setPen(QPen(m_series[i].color, 2));
+      painter.drawLine(area.left()+8, y-4, area.left()+28, y-4);
+      painter.setPen(palette().color(QPalette::Text));
+      painter.drawText(area.left()+34, y, m_series[i].name);
+      y += painter.fontMetrics().height();
+   }
+}
+
+/**
+ * @brief Draws one mission
+ * 
+ * If there are less visible samples than pixel columns, all samples are connected by lines. Otherwise,
+ * the samples of each pixel column are reduced to their first, minimum, maximum and last value.
+ */
+void PlotWidget::DrawSeries(QPainter& painter, const Series& series, const QRect& area,
+                            double minValue, double maxValue) const
+{
+   if (series.interval<=0 || series.values.isEmpty())
+      return;
+   double secondsPerPixel = (m_viewEnd-m_viewStart)/area.width();
+   double pixelsPerValue = area.height()/(maxValue-minValue);
+   int first = std::max(0, (int)std::floor((m_viewStart-series.start)/series.interval)-1);
+   int last = std::min(series.values.size()-1, (int)std::ceil((m_viewEnd-series.start)/series.interval)+1);
+   if (first>last)
+      return;
+   const double* values = series.values.constData();
+   
+   QPolygonF line;
+   if (last-first+1 <= area.width()) {
+      for (int i=first; i<=last; i++) {
+         double value = values[i];
+         if (value!=value)
+            continue;   // missing
+         double t = series.start + (double)i*series.interval;
+         line << QPointF(area.left() + (t-m_viewStart)/secondsPerPixel,
+                         area.bottom() - (value-minValue)*pixelsPerValue);
+      }
+   } else {
+      line.reserve(area.width()*4);
+      int i = first;
+      for (int x=-1; x<=area.width() && i<=last; x++) {
+         double columnEnd = m_viewStart + (x+1)*secondsPerPixel;
+         double low = std::numeric_limits<double>::infinity();
+         double high = -low;
+         double firstValue = 0, lastValue = 0;
+         for (; i<=last && series.start + (double)i*series.interval < columnEnd; i++) {
+            double value = values[i];
+            if (value!=value)
+               continue;
+            if (low>high)
+               firstValue = value;
+            lastValue = value;
+            low = std::min(low, value);
+            high = std::max(high, value);
+         }
+         if (low>high)
+            continue;
+         double px = area.left() + x + 0.5;
+         line << QPointF(px, area.bottom() - (firstValue-minValue)*pixelsPerValue)
+              << QPointF(px, area.bottom() - (low-minValue)*pixelsPerValue)
+              << QPointF(px, area.bottom() - (high-minValue)*pixelsPerValue)
+              << QPointF(px, area.bottom() - (lastValue-minValue)*pixelsPerValue);
+      }
+   }
+   painter.setPen(QPen(series.color, 1.5));
+   painter.drawPolyline(line);
+}
+
+void PlotWidget::DrawAxes(QPainter& painter, const QRect& area, double minValue, double maxValue) const
+{
+   QPen gridPen(palette().color(QPalette::Mid), 0, Qt::DotLine);
+   QPen textPen(palette().color(QPalette::Text));
+   painter.setPen(textPen);
+   painter.drawRect(area);
+   
+   // value axis: steps of 1, 2 or 5 times a power of ten, about 50 pixels apart
+   double rawStep = (maxValue-minValue)*50/area.height();
+   double magnitude = std::pow(10, std::floor(std::log10(rawStep)));
+   double step = magnitude;
+   if (rawStep>5*magnitude)
+      step = 10*magnitude;
+   else if (rawStep>2*magnitude)
+      step = 5*magnitude;
+   else if (rawStep>magnitude)
+      step = 2*magnitude;
+   for (double v=std::ceil(minValue/step)*step; v<=maxValue; v+=step) {
+      int y = area.bottom() - (v-minValue)*area.height()/(maxValue-minValue);
+      painter.setPen(gridPen);
+      painter.drawLine(area.left(), y, area.right(), y);
+      painter.setPen(textPen);
+      painter.drawText(QRect(0, y-10, area.left()-5, 20), Qt::AlignRight|Qt::AlignVCenter,
+                       QString::number(v));
+   }
+   
+   // time axis: labels about 120 pixels apart
+   static const int timeSteps[] = {1, 2, 5, 10, 15, 30, 60, 120, 300, 600, 900, 1800, 3600,
+      2*3600, 3*3600, 6*3600, 12*3600, 86400, 2*86400, 7*86400, 14*86400, 28*86400};
+   double secondsPerPixel = (m_viewEnd-m_viewStart)/area.width();
+   qint64 timeStep = timeSteps[sizeof(timeSteps)/sizeof(timeSteps[0])-1];
+   for (unsigned i=0; i<sizeof(timeSteps)/sizeof(timeSteps[0]); i++) {
+      if (timeSteps[i]/secondsPerPixel>=120) {
+         timeStep = timeSteps[i];
+         break;
+      }
+   }
+   // align ticks to local time
+   qint64 offset = QDateTime::fromMSecsSinceEpoch((qint64)m_viewStart*1000).offsetFromUtc();
+   QLocale locale;
+   for (qint64 t=((qint64)std::ceil(m_viewStart)+offset+timeStep-1)/timeStep*timeStep-offset;
+        t<=m_viewEnd; t+=timeStep) {
+      int x = area.left() + (t-m_viewStart)/secondsPerPixel;
+      painter.setPen(gridPen);
+      painter.drawLine(x, area.top(), x, area.bottom());
+      painter.setPen(textPen);
+      QDateTime time = QDateTime::fromMSecsSinceEpoch(t*1000);
+      QString label;
+      if (timeStep<60)
+         label = time.toString("HH:mm:ss");
+      else if (timeStep<86400)
+         label = time.toString("HH:mm") + "\n" + locale.toString(time.date(), QLocale::ShortFormat);
+      else
+         label = locale.toString(time.date(), QLocale::ShortFormat);
+      painter.drawText(QRect(x-60, area.bottom()+2, 120, 36), Qt::AlignHCenter|Qt::AlignTop, label);
+   }
+}
+
+void PlotWidget::wheelEvent(QWheelEvent* event)
+{
+   QRect area = PlotArea();
+   if (area.width()<=0)
+      return;
+   double factor = event->angleDelta().y()>0 ? 0.8 : 1.25;
+   double t = m_viewStart + (event->pos().x()-area.left())*(m_viewEnd-m_viewStart)/area.width();
+   double start = t - (t-m_viewStart)*factor;
+   double end = t + (m_viewEnd-t)*factor;
+   if (end-start<10)
+      return;
+   m_viewStart = start;
+   m_viewEnd = end;
+   m_follow = false;
+   update();
+}
+
+void PlotWidget::mousePressEvent(QMouseEvent* event)
+{
+   if (event->button()==Qt::LeftButton) {
+      m_dragStart = event->pos();
+      m_dragViewStart = m_viewStart;
+   }
+}
+
+void PlotWidget::mouseMoveEvent(QMouseEvent* event)
+{
+   QRect area = PlotArea();
+   if (!(event->buttons() & Qt::LeftButton) || area.width()<=0)
+      return;
+   double span = m_viewEnd-m_viewStart;
+   m_viewStart = m_dragViewStart - (event->pos().x()-m_dragStart.x())*span/area.width();
+   m_viewEnd = m_viewStart + span;
+   m_follow = false;
+   update();
+}
+
+void PlotWidget::mouseDoubleClickEvent(QMouseEvent*)
+{
+   ResetZoom();
+}
+
+void PlotWidget::contextMenuEvent(QContextMenuEvent* event)
+{
+   QMenu menu(this);
+   menu.addAction(tr("Show All"), this, SLOT(ResetZoom()));
+   menu.addAction(tr("Clear"), this, SLOT(Clear()));
+   menu.exec(event->globalPos());
+}
@@ -0,0 +1,68 @@
+#ifndef PLOTWIDGET_H
+#define PLOTWIDGET_H
+
+#include <QWidget>
+#include <QVector>
+#include <QString>
+#include <QColor>
+#include <QPoint>
+
+/**
+ * @brief Plots temperature over time for one or more missions
+ * 
+ * The samples are drawn directly from the value arrays. When there are more samples than pixels, each
+ * pixel column shows the minimum and maximum of the samples falling into it, so drawing costs one pass
+ * over the visible samples regardless of the widget size. The mouse wheel zooms the time axis around the
+ * cursor, dragging pans, and a double click shows everything again.
+ * NaN values are treated as missing samples and skipped.
+ */
+class PlotWidget : public QWidget
+{
+   Q_OBJECT
+public:
+   PlotWidget(QWidget *parent = 0);
+
+   void AddSeries(const QString& name, const QVector<double>& values, qint64 start, int interval);
+   void AppendValue(const QString& name, double time, double value, int interval);
+   bool SetSeriesValues(const QString& name, const QVector<double>& values);
+   int GetSeriesCount() const {return m_series.size();}
+
+public slots:
+   void Clear();
+   void ResetZoom();
+
+protected:
+   virtual void paintEvent(QPaintEvent* event);
+   virtual void wheelEvent(QWheelEvent* event);
+   virtual void mousePressEvent(QMouseEvent* event);
+   virtual void mouseMoveEvent(QMouseEvent* event);
+   virtual void mouseDoubleClickEvent(QMouseEvent* event);
+   virtual void contextMenuEvent(QContextMenuEvent* event);
+
+private:
+   struct Series
+   {
+      QString name;
+      QVector<double> values;
+      qint64 start;     // seconds since epoch
+      int interval;     // seconds
+      QColor color;
+   };
+   QRect PlotArea() const;
+   bool GetValueRange(double& minValue, double& maxValue) const;
+   void DrawSeries(QPainter& painter, const Series& series, const QRect& area,
+                   double minValue, double maxValue) const;
+   void DrawAxes(QPainter& painter, const QRect& area, double minValue, double maxValue) const;
+
+   // data
+private:
+   QVector<Series> m_series;
+   double m_viewStart;  // visible time range, seconds since epoch
+   double m_viewEnd;    // "
+   QPoint m_dragStart;
+   double m_dragViewStart;
+   bool m_follow;       // view shows the newest values, not zoomed or moved by the user
+   static const int m_liveWindow = 600;   // seconds of live values shown while following
+};
+
+#endif
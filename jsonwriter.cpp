@@ -0,0 +1,266 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "jsonwriter.h"
+#include <charconv>
+#include <cmath>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+
+/**
+ * @brief Constructor for writing to the file descriptor @p fd
+ * 
+ * The file descriptor is not closed by this class.
+ */
+JsonWriter::JsonWriter(int fd)
+{
+   m_fd = fd;
+   m_output = NULL;
+   m_failed = false;
+   m_depth = 0;
+   m_first[0] = true;
+   m_afterKey = false;
+   m_used = 0;
+}
+
+/**
+ * @brief Constructor for appending to @p output
+ */
+JsonWriter::JsonWriter(std::string* output)
+{
+   m_fd = -1;
+   m_output = output;
+   m_failed = false;
+   m_depth = 0;
+   m_first[0] = true;
+   m_afterKey = false;
+   m_used = 0;
+}
+
+JsonWriter::~JsonWriter()
+{
+   Flush();
+}
+
+/**
+ * @brief Returns room for @p size bytes in the buffer, flushing it if needed
+ */
+char* JsonWriter::Reserve(int size)
+{
+   if (m_used+size>(int)sizeof(m_buffer))
+      Flush();
+   return m_buffer+m_used;
+}
+
+void JsonWriter::Append(const char* text, int length)
+{
+   while (length>0) {
+      int chunk = length<(int)sizeof(m_buffer) ? length : sizeof(m_buffer);
+      memcpy(Reserve(chunk), text, chunk);
+      m_used += chunk;
+      text += chunk;
+      length -= chunk;
+   }
+}
+
+/**
+ * @brief Writes a comma before all but the first value of an object or array
+ */
+void JsonWriter::Separator()
+{
+   if (m_afterKey) {
+      m_afterKey = false;
+      return;
+   }
+   if (m_depth>0 && !m_first[m_depth])
+      m_buffer[m_used++] = ',';
+   m_first[m_depth] = false;
+}
+
+void JsonWriter::BeginObject()
+{
+   Reserve(2);
+   Separator();
+   m_buffer[m_used++] = '{';
+   if (m_depth<(int)sizeof(m_first)-1)
+      m_depth++;
+   m_first[m_depth] = true;
+}
+
+void JsonWriter::EndObject()
+{
+   Reserve(1);
+   m_buffer[m_used++] = '}';
+   if (m_depth>0)
+      m_depth--;
+}
+
+void JsonWriter::BeginArray()
+{
+   Reserve(2);
+   Separator();
+   m_buffer[m_used++] = '[';
+   if (m_depth<(int)sizeof(m_first)-1)
+      m_depth++;
+   m_first[m_depth] = true;
+}
+
+void JsonWriter::EndArray()
+{
+   Reserve(1);
+   m_buffer[m_used++] = ']';
+   if (m_depth>0)
+      m_depth--;
+}
+
+/**
+ * @brief Writes the key of the next member of an object
+ */
+void JsonWriter::Key(const char* key)
+{
+   String(key);
+   Reserve(1);
+   m_buffer[m_used++] = ':';
+   m_afterKey = true;
+}
+
+void JsonWriter::String(const char* value)
+{
+   static const char hexDigits[] = "0123456789abcdef";
+   Reserve(2);
+   Separator();
+   m_buffer[m_used++] = '"';
+   const char* start = value;
+   for (const char* p=value; ; p++)
+   {
+      unsigned char c = *p;
+      if (c>=0x20 && c!='"' && c!='\\')
+         continue;
+      Append(start, p-start);
+      if (c==0)
+         break;
+      char escape[6] = {'\\', 'u', '0', '0', hexDigits[c>>4], hexDigits[c&0x0F]};
+      if (c=='"' || c=='\\') {
+         escape[1] = c;
+         Append(escape, 2);
+      } else if (c=='\n') {
+         escape[1] = 'n';
+         Append(escape, 2);
+      } else {
+         Append(escape, 6);
+      }
+      start = p+1;
+   }
+   Reserve(1);
+   m_buffer[m_used++] = '"';
+}
+
+/**
+ * @brief Writes @p value as a string of 16 hex digits, e.g. a ROM ID
+ */
+void JsonWriter::Hex(uint64_t value)
+{
+   static const char hexDigits[] = "0123456789abcdef";
+   Reserve(19);
+   Separator();
+   char* p = m_buffer+m_used;
+   *p++ = '"';
+   for (int shift=60; shift>=0; shift-=4)
+      *p++ = hexDigits[(value>>shift)&0x0F];
+   *p++ = '"';
+   m_used = p-m_buffer;
+}
+
+void JsonWriter::Int(int64_t value)
+{
+   Reserve(22);
+   Separator();
+   m_used = std::to_chars(m_buffer+m_used, m_buffer+sizeof(m_buffer), value).ptr - m_buffer;
+}
+
+void JsonWriter::Double(double value, int precision)
+{
+   if (!std::isfinite(value)) {
+      Null();
+      return;
+   }
+   Reserve(33);
+   Separator();
+   m_used = std::to_chars(m_buffer+m_used, m_buffer+sizeof(m_buffer), value, std::chars_format::general,
+                          precision).ptr - m_buffer;
+}
+
+void JsonWriter::Bool(bool value)
+{
+   Reserve(6);
+   Separator();
+   Append(value ? "true" : "false", value ? 4 : 5);
+}
+
+void JsonWriter::Null()
+{
+   Reserve(5);
+   Separator();
+   Append("null", 4);
+}
+
+/**
+ * @brief Ends a top level value with a newline, for JSON lines output
+ */
+bool JsonWriter::EndLine()
+{
+   Reserve(1);
+   m_buffer[m_used++] = '\n';
+   m_depth = 0;
+   m_first[0] = true;
+   m_afterKey = false;
+   return !m_failed;
+}
+
+/**
+ * @brief Writes the buffered output
+ */
+bool JsonWriter::Flush()
+{
+   if (m_failed) {
+      m_used = 0;
+      return false;
+   }
+   if (m_output) {
+      m_output->append(m_buffer, m_used);
+      m_used = 0;
+      return true;
+   }
+   int written = 0;
+   while (written<m_used) {
+      ssize_t result = write(m_fd, m_buffer+written, m_used-written);
+      if (result<0) {
+         if (errno==EINTR)
+            continue;
+         m_lastError = strerror(errno);
+         m_failed = true;
+         m_used = 0;
+         return false;
+      }
+      written += result;
+   }
+   m_used = 0;
+   return true;
+}
@@ -0,0 +1,75 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <string>
+#include <cstdint>
+
+/**
+ * @brief Writes JSON text without building a document tree
+ * 
+ * Values are written directly into a fixed buffer, which is written to a file descriptor or appended to a string
+ * when it fills up or on Flush(). Separators are inserted according to the current nesting. Numbers are
+ * formatted with std::to_chars, non-finite doubles are written as null.
+ * Write errors are sticky: later output is dropped, and EndLine() and Flush() return false. The error message is
+ * available from GetLastError().
+ */
+class JsonWriter
+{
+public:
+   JsonWriter(int fd);
+   JsonWriter(std::string* output);
+   ~JsonWriter();
+   
+public:
+   std::string GetLastError() {return m_lastError;}
+   void BeginObject();
+   void EndObject();
+   void BeginArray();
+   void EndArray();
+   void Key(const char* key);
+   void String(const char* value);
+   void Hex(uint64_t value);
+   void Int(int64_t value);
+   void Double(double value, int precision=6);
+   void Bool(bool value);
+   void Null();
+   bool EndLine();
+   bool Flush();
+   
+protected:
+   void Separator();
+   char* Reserve(int size);
+   void Append(const char* text, int length);
+   
+   // Data
+private:
+   std::string m_lastError;
+   int m_fd;
+   std::string* m_output;
+   bool m_failed;
+   int m_depth;
+   bool m_first[32];      // no value written yet at this nesting level
+   bool m_afterKey;
+   int m_used;
+   char m_buffer[65536];
+};
+
+#endif // JSONWRITER_H
@@ -0,0 +1,144 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "livemonitor.h"
+#include "ds9490.h"
+#include "ds1922.h"
+#include <list>
+#include <cmath>
+#include <ctime>
+#include <errno.h>
+
+LiveMonitor::LiveMonitor()
+{
+}
+
+LiveMonitor::~LiveMonitor()
+{
+   for (size_t i=0; i<m_busses.size(); i++)
+   {
+      for (size_t j=0; j<m_busses[i].loggers.size(); j++)
+         delete m_busses[i].loggers[j];
+   }
+}
+
+/**
+ * @brief Searches the bus of @p ds9490 and adds the loggers that can convert
+ * 
+ * Loggers with a mission in progress or a stopped clock cannot do forced conversions and are left out.
+ * @p ds9490 needs to have a lifetime longer than this object.
+ * @param int adapter: number of the adapter, passed back with each reading.
+ * @return bool: false if the bus could not be searched, the error is available from GetError().
+ */
+bool LiveMonitor::AddBus(DS9490* ds9490, int adapter)
+{
+   std::list<uint64_t> serials;
+   if (!ds9490->Scan1WBus(serials)) {
+      m_error = ds9490->GetError();
+      return false;
+   }
+   Bus bus;
+   bus.ds9490 = ds9490;
+   bus.adapter = adapter;
+   bus.broadcast = true;
+   for (std::list<uint64_t>::iterator it=serials.begin(); it!=serials.end(); ++it)
+   {
+      if ((*it & 0xFF)!=DS1922::m_familyCode) {
+         bus.broadcast = false;
+         continue;
+      }
+      DS1922* ds1922 = new DS1922(ds9490, *it);
+      if (!ds1922->ReadRegister() || ds1922->GetMissionInProgress() || !ds1922->GetRtcEnabled()) {
+         delete ds1922;
+         continue;
+      }
+      bus.loggers.push_back(ds1922);
+   }
+   if (!bus.loggers.empty())
+      m_busses.push_back(bus);
+   return true;
+}
+
+int LiveMonitor::GetLoggerCount()
+{
+   int count = 0;
+   for (size_t i=0; i<m_busses.size(); i++)
+      count += m_busses[i].loggers.size();
+   return count;
+}
+
+/**
+ * @brief Converts and reads the temperature of all loggers
+ * 
+ * Blocks for about DS1922::m_conversionTime. Loggers that fail are returned with their error.
+ * @return bool: false if there are no loggers.
+ */
+bool LiveMonitor::Poll(std::vector<Reading>& readings)
+{
+   readings.clear();
+   if (m_busses.empty()) {
+      m_error = DeviceError(DeviceError::NO_PRESENCE);
+      return false;
+   }
+   // start the conversions on all busses, so they run at the same time
+   timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   double time = now.tv_sec + now.tv_nsec/1e9;
+   for (size_t i=0; i<m_busses.size(); i++)
+   {
+      Bus& bus = m_busses[i];
+      DeviceError error;
+      if (bus.broadcast) {
+         DS1922 all(bus.ds9490, 0);
+         if (!all.ForceConversion())
+            error = all.GetError();
+      }
+      for (size_t j=0; j<bus.loggers.size(); j++)
+      {
+         Reading reading;
+         reading.adapter = bus.adapter;
+         reading.rom = bus.loggers[j]->GetRom();
+         reading.time = time;
+         reading.temperature = NAN;
+         reading.error = error;
+         if (!bus.broadcast && !bus.loggers[j]->ForceConversion())
+            reading.error = bus.loggers[j]->GetError();
+         readings.push_back(reading);
+      }
+   }
+   timespec wakeup;
+   clock_gettime(CLOCK_MONOTONIC, &wakeup);
+   wakeup.tv_nsec += DS1922::m_conversionTime*1000000L;
+   wakeup.tv_sec += wakeup.tv_nsec/1000000000L;
+   wakeup.tv_nsec %= 1000000000L;
+   while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup, NULL)==EINTR)
+      ;
+   size_t n = 0;
+   for (size_t i=0; i<m_busses.size(); i++)
+   {
+      for (size_t j=0; j<m_busses[i].loggers.size(); j++, n++)
+      {
+         if (readings[n].error.code!=DeviceError::NONE)
+            continue;
+         DS1922* ds1922 = m_busses[i].loggers[j];
+         if (!ds1922->ReadLatestTemperature(readings[n].temperature))
+            readings[n].error = ds1922->GetError();
+      }
+   }
+   return true;
+}
@@ -0,0 +1,75 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LIVEMONITOR_H
+#define LIVEMONITOR_H
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "deviceerror.h"
+
+class DS9490;
+class DS1922;
+
+/**
+ * @brief Reads the current temperature of DS1922 loggers, using forced conversions
+ * 
+ * Loggers without a mission in progress are added per bus with AddBus(). Each Poll() first starts the conversions
+ * on all busses, then waits once for DS1922::m_conversionTime and reads the results, so a round takes about
+ * one conversion time regardless of the number of loggers. If all devices on a bus are loggers, one conversion
+ * command with Skip ROM starts all of them; otherwise each logger is addressed in turn.
+ */
+class LiveMonitor
+{
+public:
+   LiveMonitor();
+   ~LiveMonitor();
+   
+public:
+   struct Reading
+   {
+      int adapter;
+      uint64_t rom;
+      double time;            // start of the conversion, seconds since epoch
+      double temperature;     // °C, NaN on error
+      DeviceError error;
+   };
+   
+   std::string GetLastError() {return m_error.ToString();}
+   const DeviceError& GetError() {return m_error;}
+   bool AddBus(DS9490* ds9490, int adapter=0);
+   int GetLoggerCount();
+   bool Poll(std::vector<Reading>& readings);
+   
+protected:
+   struct Bus
+   {
+      DS9490* ds9490;
+      int adapter;
+      bool broadcast;         // only loggers on the bus, convert with Skip ROM
+      std::vector<DS1922*> loggers;
+   };
+   
+   // Data
+private:
+   DeviceError m_error;
+   std::vector<Bus> m_busses;
+};
+
+#endif // LIVEMONITOR_H
@@ -0,0 +1,113 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "missionmerger.h"
+#include "ds1922.h"
+#include "ds1922snapshot.h"
+#include <string.h>
+
+
+MissionMerger::MissionMerger()
+{
+   m_missionStart = 0;
+   m_interval = 0;
+   m_endSample = 0;
+}
+
+/**
+ * @brief Describes the samples available in @p ds1922
+ * 
+ * ReadRegister() has to be called on @p ds1922 before.
+ */
+MissionMerger::Snapshot MissionMerger::TakeSnapshot(DS1922& ds1922)
+{
+   Snapshot snapshot;
+   tm timeStamp;
+   memset(&timeStamp, 0, sizeof(timeStamp));
+   ds1922.GetMissionTimestamp(&timeStamp);
+   timeStamp.tm_isdst = -1;
+   snapshot.missionStart = mktime(&timeStamp);
+   snapshot.interval = ds1922.GetSampleRate();
+   if (!ds1922.GetHighspeedSampling())
+      snapshot.interval *= 60;
+   snapshot.endSample = ds1922.GetSampleCount();
+   snapshot.firstSample = snapshot.endSample - ds1922.GetLogCapacity();
+   if (snapshot.firstSample<0)
+      snapshot.firstSample = 0;
+   return snapshot;
+}
+
+/**
+ * @brief Describes the samples held by @p snapshot
+ */
+MissionMerger::Snapshot MissionMerger::TakeSnapshot(const DS1922Snapshot& snapshot)
+{
+   Snapshot result;
+   result.missionStart = snapshot.GetMissionTimestamp();
+   result.interval = snapshot.GetInterval();
+   result.endSample = snapshot.GetSampleCount();
+   result.firstSample = result.endSample - snapshot.GetLogCapacity();
+   if (result.firstSample<0)
+      result.firstSample = 0;
+   return result;
+}
+
+/**
+ * @brief Aligns @p snapshot with the samples merged so far
+ * 
+ * A different mission start or interval, or fewer samples than already merged, start a new mission.
+ */
+MissionMerger::Step MissionMerger::Plan(const Snapshot& snapshot) const
+{
+   Step step;
+   step.snapshot = snapshot;
+   step.newMission = !m_endSample || snapshot.missionStart!=m_missionStart || snapshot.interval!=m_interval
+                     || snapshot.endSample<m_endSample;
+   step.lost.firstSample = 0;
+   step.lost.count = 0;
+   step.first = snapshot.firstSample;
+   if (!step.newMission) {
+      if (m_endSample<snapshot.firstSample) {
+         step.lost.firstSample = m_endSample;
+         step.lost.count = snapshot.firstSample - m_endSample;
+      } else {
+         step.first = m_endSample;
+      }
+   }
+   step.count = snapshot.endSample - step.first;
+   if (step.count<0)
+      step.count = 0;
+   return step;
+}
+
+/**
+ * @brief Records that the samples of @p step were merged
+ */
+void MissionMerger::Commit(const Step& step)
+{
+   if (step.newMission) {
+      m_missionStart = step.snapshot.missionStart;
+      m_interval = step.snapshot.interval;
+      m_gaps.clear();
+      m_endSample = step.first;
+   }
+   if (step.lost.count>0)
+      m_gaps.push_back(step.lost);
+   if (step.first+step.count>m_endSample)
+      m_endSample = step.first + step.count;
+}
@@ -0,0 +1,82 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MISSIONMERGER_H
+#define MISSIONMERGER_H
+
+#include <vector>
+#include <ctime>
+
+class DS1922;
+class DS1922Snapshot;
+
+/**
+ * @brief Stitches repeated readouts of a logger into one continuous series per mission
+ * 
+ * Every readout is described by a Snapshot: the mission it belongs to, identified by its start time and sample
+ * interval, and the range of mission sample numbers still available in the device. Plan() aligns a snapshot
+ * with the samples merged so far and returns the range to download: only the samples after the last merged
+ * one, or all available samples of a new mission. If samples were overwritten by rollover before they could be
+ * read, the lost range is reported, and kept in the list of gaps of the mission once the step is committed.
+ * Each step takes constant time, merged samples are never looked at again.
+ */
+class MissionMerger
+{
+public:
+   MissionMerger();
+   
+public:
+   struct Snapshot
+   {
+      time_t missionStart;
+      int interval;        // seconds between samples
+      int firstSample;     // mission sample number of the oldest available sample
+      int endSample;       // mission sample number after the newest available sample
+   };
+   struct Gap
+   {
+      int firstSample;
+      int count;
+   };
+   struct Step
+   {
+      Snapshot snapshot;
+      bool newMission;
+      int first;           // first mission sample number to download
+      int count;           // number of samples to download, 0 if nothing is new
+      Gap lost;            // count is 0 if no samples were lost
+   };
+   
+   static Snapshot TakeSnapshot(DS1922& ds1922);
+   static Snapshot TakeSnapshot(const DS1922Snapshot& snapshot);
+   Step Plan(const Snapshot& snapshot) const;
+   void Commit(const Step& step);
+   bool HasMission() const {return m_endSample>0;}
+   time_t GetMissionStart() const {return m_missionStart;}
+   int GetEndSample() const {return m_endSample;}
+   const std::vector<Gap>& GetGaps() const {return m_gaps;}
+   
+   // Data
+private:
+   time_t m_missionStart;
+   int m_interval;
+   int m_endSample;      // mission sample number after the last merged sample
+   std::vector<Gap> m_gaps;
+};
+
+#endif // MISSIONMERGER_H
@@ -0,0 +1,116 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "missionstatistics.h"
+#include "ds1922.h"
+#include <cmath>
+#include <limits>
+
+
+static const double activationEnergyByR = 83144.0/8.3144;   // ΔH/R [K]
+static const double kelvin = 273.15;
+
+MissionStatistics::MissionStatistics()
+{
+   Compute(NULL, 0, 0, 0, 0);
+}
+
+/**
+ * @brief Computes the statistics of @p count values, taken every @p interval seconds
+ * 
+ * Values below @p lowThreshold or above @p highThreshold are counted as excursions.
+ */
+void MissionStatistics::Compute(const double* values, int count, int interval, double lowThreshold,
+                                double highThreshold)
+{
+   m_interval = interval;
+   m_lowThreshold = lowThreshold;
+   m_highThreshold = highThreshold;
+   
+   const double infinity = std::numeric_limits<double>::infinity();
+   double minimum = infinity;
+   double maximum = -infinity;
+   double sum = 0;
+   double kineticSum = 0;
+   int valid = 0;
+   int below = 0, above = 0;
+   int excursionsBelow = 0, excursionsAbove = 0;
+   int runBelow = 0, runAbove = 0;
+   int longestBelow = 0, longestAbove = 0;
+   for (int i=0; i<count; i++)
+   {
+      double value = values[i];
+      if (value==value) {
+         // missing values (NaN) are skipped
+         if (value<minimum)
+            minimum = value;
+         if (value>maximum)
+            maximum = value;
+         sum += value;
+         kineticSum += std::exp(-activationEnergyByR/(value+kelvin));
+         valid++;
+      }
+      // comparisons with NaN are false, so missing values end a run
+      if (value<lowThreshold) {
+         below++;
+         if (runBelow==0)
+            excursionsBelow++;
+         runBelow++;
+         if (runBelow>longestBelow)
+            longestBelow = runBelow;
+      } else {
+         runBelow = 0;
+      }
+      if (value>highThreshold) {
+         above++;
+         if (runAbove==0)
+            excursionsAbove++;
+         runAbove++;
+         if (runAbove>longestAbove)
+            longestAbove = runAbove;
+      } else {
+         runAbove = 0;
+      }
+   }
+   
+   const double nan = std::numeric_limits<double>::quiet_NaN();
+   m_count = valid;
+   m_min = valid ? minimum : nan;
+   m_max = valid ? maximum : nan;
+   m_mean = valid ? sum/valid : nan;
+   m_meanKinetic = valid ? activationEnergyByR/-std::log(kineticSum/valid) - kelvin : nan;
+   m_samplesBelow = below;
+   m_samplesAbove = above;
+   m_excursionsBelow = excursionsBelow;
+   m_excursionsAbove = excursionsAbove;
+   m_longestBelow = longestBelow;
+   m_longestAbove = longestAbove;
+}
+
+/**
+ * @brief Computes the statistics of samples of the mission of @p ds1922, using its alarm thresholds
+ * 
+ * ReadRegister() has to be called on @p ds1922 before.
+ */
+void MissionStatistics::Compute(DS1922& ds1922, const double* values, int count)
+{
+   int interval = ds1922.GetSampleRate();
+   if (!ds1922.GetHighspeedSampling())
+      interval *= 60;
+   Compute(values, count, interval, ds1922.GetAlarmLowThreshold(), ds1922.GetAlarmHighThreshold());
+}
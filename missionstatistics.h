@@ -0,0 +1,75 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MISSIONSTATISTICS_H
+#define MISSIONSTATISTICS_H
+
+class DS1922;
+
+/**
+ * @brief Summary statistics and threshold excursions of a sample series
+ * 
+ * Compute() makes a single pass over the values. It is not vectorized: the runs of excursions are sequential,
+ * the exp() of the mean kinetic temperature is a call, and the floating point sums are kept in order, so the
+ * results do not depend on compiler flags. Missing values (NaN) are skipped, and end an excursion. An excursion
+ * is a run of consecutive samples below the low or above the high threshold.
+ * The mean kinetic temperature uses an activation energy of 83.144 kJ/mol, as usual for pharmaceuticals.
+ */
+class MissionStatistics
+{
+public:
+   MissionStatistics();
+   
+public:
+   void Compute(const double* values, int count, int interval, double lowThreshold, double highThreshold);
+   void Compute(DS1922& ds1922, const double* values, int count);
+   int GetCount() {return m_count;}           // valid samples
+   double GetMin() {return m_min;}            // NaN without valid samples
+   double GetMax() {return m_max;}            // "
+   double GetMean() {return m_mean;}          // "
+   double GetMeanKinetic() {return m_meanKinetic;} // "
+   int GetSamplesBelow() {return m_samplesBelow;}
+   int GetSamplesAbove() {return m_samplesAbove;}
+   long GetTimeBelow() {return (long)m_samplesBelow*m_interval;}   // seconds
+   long GetTimeAbove() {return (long)m_samplesAbove*m_interval;}   // "
+   int GetExcursionsBelow() {return m_excursionsBelow;}
+   int GetExcursionsAbove() {return m_excursionsAbove;}
+   int GetLongestBelow() {return m_longestBelow;}   // samples of the longest excursion
+   int GetLongestAbove() {return m_longestAbove;}   // "
+   double GetLowThreshold() {return m_lowThreshold;}
+   double GetHighThreshold() {return m_highThreshold;}
+   
+   // Data
+private:
+   int m_interval;
+   double m_lowThreshold;
+   double m_highThreshold;
+   int m_count;
+   double m_min;
+   double m_max;
+   double m_mean;
+   double m_meanKinetic;
+   int m_samplesBelow;
+   int m_samplesAbove;
+   int m_excursionsBelow;
+   int m_excursionsAbove;
+   int m_longestBelow;
+   int m_longestAbove;
+};
+
+#endif // MISSIONSTATISTICS_H
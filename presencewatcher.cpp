@@ -0,0 +1,70 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "presencewatcher.h"
+#include "ds9490.h"
+
+
+/**
+ * @brief Constructor
+ * 
+ * @param DS9490* ds9490: Pointer to an instance of class DS9490, which needs to have a lifetime longer than this object.
+ */
+PresenceWatcher::PresenceWatcher(DS9490* ds9490)
+{
+   m_ds9490 = ds9490;
+   m_adapterCount = 0;
+   m_devicePresent = false;
+}
+
+/**
+ * @brief Checks for changes of the adapter and the 1-Wire bus
+ * 
+ * At most one event is returned per call. If the adapter is open, this costs one 1-Wire reset. Otherwise
+ * the USB busses are only rescanned, and the adapter is opened if the number of attached adapters changed
+ * since the last successful open. A failed open is retried.
+ */
+PresenceWatcher::Event PresenceWatcher::Poll()
+{
+   if (!m_ds9490->DeviceOpen()) {
+      int count = DS9490::CountUsbDevices();
+      if (count==m_adapterCount)
+         return NoEvent;
+      if (count==0 || !m_ds9490->OpenUsbDevice()) {
+         // a failed open, e.g. before udev has set the permissions, is retried on the next call
+         m_adapterCount = 0;
+         return NoEvent;
+      }
+      m_adapterCount = count;
+      return AdapterAttached;
+   }
+   
+   bool present;
+   if (!m_ds9490->DetectPresence(present)) {
+      // adapter gone, start over
+      m_ds9490->CloseUsbDevice();
+      m_adapterCount = 0;
+      m_devicePresent = false;
+      return AdapterDetached;
+   }
+   if (present==m_devicePresent)
+      return NoEvent;
+   m_devicePresent = present;
+   return present ? DeviceArrived : DeviceDeparted;
+}
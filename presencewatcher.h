@@ -0,0 +1,48 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PRESENCEWATCHER_H
+#define PRESENCEWATCHER_H
+
+class DS9490;
+
+/**
+ * @brief Detects USB adapters being plugged in and iButtons being seated on the reader
+ * 
+ * Poll() has to be called periodically, e.g. from a timer. It opens the DS9490 as soon as one is attached,
+ * and checks the 1-Wire bus for a presence pulse with a single reset. The returned event can be used to start
+ * a readout as soon as an iButton is seated.
+ */
+class PresenceWatcher
+{
+public:
+   PresenceWatcher(DS9490* ds9490);
+   
+public:
+   enum Event {NoEvent, AdapterAttached, AdapterDetached, DeviceArrived, DeviceDeparted};
+   PresenceWatcher::Event Poll();
+   bool GetDevicePresent() {return m_devicePresent;}
+   
+   // Data
+private:
+   DS9490* m_ds9490;
+   int m_adapterCount;
+   bool m_devicePresent;
+};
+
+#endif // PRESENCEWATCHER_H
@@ -0,0 +1,266 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "provisioner.h"
+#include "ds1922.h"
+#include "ds9490.h"
+#include <list>
+#include <cmath>
+#include <thread>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+Provisioner::Provisioner()
+{
+}
+
+/**
+ * @brief Parses a mission template from comma separated settings
+ * 
+ * Settings: rate=N (sample rate, default 10), unit=s|min (default min), highres=0|1, low=T and high=T
+ * (enable the alarm with threshold T °C), delay=N (mission start delay in minutes), rollover=0|1,
+ * startuponalarm=0|1, rtc=0|1 (set the clock to the system time, default 1).
+ * Example: "rate=5,unit=min,highres=1,low=2,high=8"
+ */
+bool Provisioner::ParseTemplate(const char* text, MissionTemplate& missionTemplate, std::string& error)
+{
+   MissionTemplate result;
+   memset(&result, 0, sizeof(result));
+   result.sampleRate = 10;
+   result.setRtc = true;
+   std::string settings = text;
+   size_t pos = 0;
+   while (pos<settings.size()) {
+      size_t end = settings.find(',', pos);
+      if (end==std::string::npos)
+         end = settings.size();
+      std::string setting = settings.substr(pos, end-pos);
+      pos = end+1;
+      if (setting.empty())
+         continue;
+      size_t equals = setting.find('=');
+      std::string key = setting.substr(0, equals);
+      std::string value = equals!=std::string::npos ? setting.substr(equals+1) : "1";
+      char* valueEnd;
+      double number = strtod(value.c_str(), &valueEnd);
+      bool isNumber = !value.empty() && *valueEnd==0;
+      if (key=="unit" && (value=="s" || value=="min")) {
+         result.highspeed = value=="s";
+         continue;
+      }
+      if (!isNumber) {
+         error = "Invalid value of "+key;
+         return false;
+      }
+      if (key=="rate" && number>=1 && number<=0x3FFF) {
+         result.sampleRate = number;
+      } else if (key=="highres") {
+         result.highResLogging = number!=0;
+      } else if (key=="low") {
+         result.alarmLowEnabled = true;
+         result.alarmLowThreshold = number;
+      } else if (key=="high") {
+         result.alarmHighEnabled = true;
+         result.alarmHighThreshold = number;
+      } else if (key=="delay" && number>=0 && number<=0xFFFFFF) {
+         result.missionStartDelay = number;
+      } else if (key=="rollover") {
+         result.rollover = number!=0;
+      } else if (key=="startuponalarm") {
+         result.startUponAlarm = number!=0;
+      } else if (key=="rtc") {
+         result.setRtc = number!=0;
+      } else {
+         error = "Invalid setting "+setting;
+         return false;
+      }
+   }
+   missionTemplate = result;
+   return true;
+}
+
+/**
+ * @brief Prepares all loggers on all adapters according to @p missionTemplate
+ * 
+ * @return bool: false if no adapter was found. The result of each logger is in @p results, also on failure.
+ */
+bool Provisioner::Run(const MissionTemplate& missionTemplate, std::vector<Result>& results)
+{
+   m_results.clear();
+   int adapters = DS9490::CountUsbDevices();
+   if (adapters==0) {
+      m_lastError = "No DS2490 found";
+      results.clear();
+      return false;
+   }
+   // all adapters are opened before the threads start, as the USB enumeration of libusb is not thread safe
+   std::vector<DS9490*> ds9490s;
+   for (int i=0; i<adapters; i++)
+   {
+      ds9490s.push_back(new DS9490);
+      if (!ds9490s[i]->OpenUsbDevice(i))
+         ReportScanError(i, ds9490s[i]->GetLastError());
+   }
+   std::vector<std::thread> threads;
+   for (int i=0; i<adapters; i++)
+   {
+      if (ds9490s[i]->DeviceOpen())
+         threads.push_back(std::thread(&Provisioner::ProvisionAdapter, this, i, ds9490s[i],
+                                       std::cref(missionTemplate)));
+   }
+   for (size_t i=0; i<threads.size(); i++)
+      threads[i].join();
+   for (size_t i=0; i<ds9490s.size(); i++)
+      delete ds9490s[i];
+   results = m_results;
+   return true;
+}
+
+/**
+ * @brief Provisions the loggers on the bus of the opened adapter @p ds9490, one after the other
+ */
+void Provisioner::ProvisionAdapter(int adapter, DS9490* ds9490, const MissionTemplate& missionTemplate)
+{
+   std::list<uint64_t> serials;
+   if (!ds9490->Scan1WBus(serials, DS1922::m_familyCode)) {
+      ReportScanError(adapter, ds9490->GetLastError());
+      return;
+   }
+   for (std::list<uint64_t>::iterator it=serials.begin(); it!=serials.end(); ++it)
+   {
+      DS1922 ds1922(ds9490, *it);
+      Result result;
+      result.adapter = adapter;
+      result.rom = *it;
+      result.rtcSkew = NAN;
+      result.ok = ProvisionLogger(ds1922, missionTemplate, result);
+      Report(result);
+   }
+}
+
+void Provisioner::ReportScanError(int adapter, const std::string& error)
+{
+   Result result;
+   result.adapter = adapter;
+   result.rom = 0;
+   result.ok = false;
+   result.step = "scan";
+   result.error = error;
+   result.rtcSkew = NAN;
+   Report(result);
+}
+
+/**
+ * @brief Stops, clears, configures and starts @p ds1922, verifying each step
+ */
+bool Provisioner::ProvisionLogger(DS1922& ds1922, const MissionTemplate& missionTemplate, Result& result)
+{
+   // positions in the configuration pages, see the datasheet
+   const int generalStatus = 0x15;
+   const uint8_t memoryCleared = 0x08;
+   uint8_t expected[64], actual[64];
+   
+   result.step = "read";
+   if (!ds1922.ReadRegister()) {
+      result.error = ds1922.GetLastError();
+      return false;
+   }
+   if (ds1922.GetMissionInProgress()) {
+      result.step = "stop";
+      if (!ds1922.StopMission() || !ds1922.ReadRegister()) {
+         result.error = ds1922.GetLastError();
+         return false;
+      }
+      if (ds1922.GetMissionInProgress()) {
+         result.error = "Mission still in progress";
+         return false;
+      }
+   }
+   
+   result.step = "clear";
+   if (!ds1922.ClearMemory() || !ds1922.ReadRegister()) {
+      result.error = ds1922.GetLastError();
+      return false;
+   }
+   ds1922.GetRegister(actual);
+   if (!(actual[generalStatus] & memoryCleared) || ds1922.GetSampleCount()!=0) {
+      result.error = "Memory not cleared";
+      return false;
+   }
+   
+   result.step = "configure";
+   ds1922.SetRtcEnabled(true);
+   ds1922.SetRtcHighspeed(missionTemplate.highspeed);
+   ds1922.SetSampleRate(missionTemplate.sampleRate);
+   ds1922.SetAlarmEnabled(missionTemplate.alarmLowEnabled, missionTemplate.alarmHighEnabled);
+   ds1922.SetAlarmLowThreshold(missionTemplate.alarmLowThreshold);
+   ds1922.SetAlarmHighThreshold(missionTemplate.alarmHighThreshold);
+   ds1922.SetHighResLogging(missionTemplate.highResLogging);
+   ds1922.SetMissionStartDelay(missionTemplate.missionStartDelay);
+   ds1922.SetRollover(missionTemplate.rollover);
+   ds1922.SetStartUponAlarm(missionTemplate.startUponAlarm);
+   ds1922.SetLoggingEnabled(true);
+   ds1922.GetRegister(expected);
+   if (!ds1922.WriteRegister() || !ds1922.ReadRegister()) {
+      result.error = ds1922.GetLastError();
+      return false;
+   }
+   // sample rate, alarm thresholds, alarm enable, RTC control, mission control, start delay
+   static const int written[] = {0x06, 0x07, 0x08, 0x09, 0x10, 0x12, 0x13, 0x16, 0x17, 0x18};
+   ds1922.GetRegister(actual);
+   for (size_t i=0; i<sizeof(written)/sizeof(written[0]); i++)
+   {
+      if (actual[written[i]]!=expected[written[i]]) {
+         char buffer[64];
+         snprintf(buffer, sizeof(buffer), "Register 0x%03X is 0x%02X instead of 0x%02X",
+                  0x200+written[i], actual[written[i]], expected[written[i]]);
+         result.error = buffer;
+         return false;
+      }
+   }
+   
+   if (missionTemplate.setRtc) {
+      result.step = "clock";
+      if (!ds1922.SyncRtc(&result.rtcSkew)) {
+         result.error = ds1922.GetLastError();
+         return false;
+      }
+   }
+   
+   result.step = "start";
+   if (!ds1922.StartMission() || !ds1922.ReadRegister()) {
+      result.error = ds1922.GetLastError();
+      return false;
+   }
+   if (!ds1922.GetMissionInProgress()) {
+      result.error = "Mission not started";
+      return false;
+   }
+   result.step.clear();
+   return true;
+}
+
+void Provisioner::Report(const Result& result)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_results.push_back(result);
+   if (m_resultHandler)
+      m_resultHandler(result);
+}
@@ -0,0 +1,91 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROVISIONER_H
+#define PROVISIONER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+class DS9490;
+class DS1922;
+
+/**
+ * @brief Prepares all loggers on all attached DS9490 adapters for a new mission
+ * 
+ * Every logger found is brought into the state described by a MissionTemplate: a running mission is stopped,
+ * the logging memory is cleared, the configuration is written, the clock is synchronized with
+ * DS1922::SyncRtc(), and the mission is started. Every step is
+ * verified by reading the configuration back. The adapters are opened by the calling thread, as the USB
+ * enumeration is not thread safe, and then worked on in parallel, one thread per adapter;
+ * the loggers on one bus are prepared one after the other.
+ * The result of each logger is passed to the result handler as soon as it is known, and returned by Run().
+ */
+class Provisioner
+{
+public:
+   Provisioner();
+   
+public:
+   struct MissionTemplate
+   {
+      int sampleRate;            // in minutes, or seconds with highspeed
+      bool highspeed;
+      bool highResLogging;
+      bool alarmLowEnabled;
+      bool alarmHighEnabled;
+      double alarmLowThreshold;  // °C
+      double alarmHighThreshold; // °C
+      int missionStartDelay;     // minutes
+      bool rollover;
+      bool startUponAlarm;
+      bool setRtc;               // set the clock to the system time
+   };
+   struct Result
+   {
+      int adapter;
+      uint64_t rom;
+      bool ok;
+      std::string step;          // the step that failed
+      std::string error;
+      double rtcSkew;            // device clock - system clock [s] after synchronization, NaN if not set
+   };
+   
+   std::string GetLastError() {return m_lastError;}
+   static bool ParseTemplate(const char* text, MissionTemplate& missionTemplate, std::string& error);
+   void SetResultHandler(std::function<void(const Result&)> handler) {m_resultHandler = handler;}
+   bool Run(const MissionTemplate& missionTemplate, std::vector<Result>& results);
+   
+protected:
+   void ProvisionAdapter(int adapter, DS9490* ds9490, const MissionTemplate& missionTemplate);
+   void ReportScanError(int adapter, const std::string& error);
+   bool ProvisionLogger(DS1922& ds1922, const MissionTemplate& missionTemplate, Result& result);
+   void Report(const Result& result);
+   
+   // Data
+private:
+   std::string m_lastError;
+   std::mutex m_mutex;     // protects m_results and calls of m_resultHandler
+   std::vector<Result> m_results;
+   std::function<void(const Result&)> m_resultHandler;
+};
+
+#endif // PROVISIONER_H
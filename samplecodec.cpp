@@ -0,0 +1,162 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "samplecodec.h"
+#include <string.h>
+
+
+static inline uint32_t ZigZag(int32_t value)
+{
+   return ((uint32_t)value<<1) ^ (uint32_t)(value>>31);
+}
+
+static inline int32_t UnZigZag(uint32_t value)
+{
+   return (int32_t)(value>>1) ^ -(int32_t)(value&1);
+}
+
+static int BitWidth(uint32_t value)
+{
+   int width = 0;
+   while (value) {
+      width++;
+      value >>= 1;
+   }
+   return width;
+}
+
+/**
+ * @brief Appends the encoded stream of @p count values to @p output
+ */
+void SampleCodec::Encode(const int32_t* values, int count, std::vector<uint8_t>& output)
+{
+   if (count<=0)
+      return;
+   // common power of 2 of all differences
+   uint32_t bits = 0;
+   for (int i=1; i<count; i++)
+      bits |= (uint32_t)values[i]-(uint32_t)values[i-1];
+   int shift = 0;
+   while (bits && !(bits&1) && shift<31) {
+      bits >>= 1;
+      shift++;
+   }
+   output.push_back(shift);
+   uint32_t first = ZigZag(values[0]);
+   while (first>=0x80) {
+      output.push_back((first&0x7F) | 0x80);
+      first >>= 7;
+   }
+   output.push_back(first);
+   
+   uint32_t block[m_blockSize];
+   for (int start=1; start<count; start+=m_blockSize)
+   {
+      int n = count-start<m_blockSize ? count-start : m_blockSize;
+      uint32_t maximum = 0;
+      for (int i=0; i<n; i++)
+      {
+         int32_t difference = (uint32_t)values[start+i]-(uint32_t)values[start+i-1];
+         block[i] = ZigZag(difference>>shift);
+         maximum |= block[i];
+      }
+      int width = BitWidth(maximum);
+      output.push_back(width);
+      uint64_t accumulator = 0;
+      int accumulated = 0;
+      for (int i=0; i<n; i++)
+      {
+         accumulator |= (uint64_t)block[i]<<accumulated;
+         accumulated += width;
+         while (accumulated>=8) {
+            output.push_back(accumulator&0xFF);
+            accumulator >>= 8;
+            accumulated -= 8;
+         }
+      }
+      if (accumulated>0)
+         output.push_back(accumulator&0xFF);
+   }
+}
+
+/**
+ * @brief Decodes @p count values from the stream in @p data
+ * 
+ * @return bool: false if the stream is truncated or invalid
+ */
+bool SampleCodec::Decode(const uint8_t* data, size_t size, int32_t* values, int count)
+{
+   if (count<=0)
+      return true;
+   const uint8_t* end = data+size;
+   if (data>=end)
+      return false;
+   int shift = *data++;
+   if (shift>31)
+      return false;
+   uint32_t first = 0;
+   for (int bit=0; ; bit+=7)
+   {
+      if (data>=end || bit>28)
+         return false;
+      first |= (uint32_t)(*data&0x7F)<<bit;
+      if (!(*data++&0x80))
+         break;
+   }
+   values[0] = UnZigZag(first);
+   
+   // one block of packed data, plus room for the 8 byte reads beyond its end
+   uint8_t packed[m_blockSize*4+8];
+   uint32_t block[m_blockSize];
+   for (int start=1; start<count; start+=m_blockSize)
+   {
+      int n = count-start<m_blockSize ? count-start : m_blockSize;
+      if (data>=end)
+         return false;
+      int width = *data++;
+      if (width>32)
+         return false;
+      size_t bytes = ((size_t)n*width+7)/8;
+      if (bytes>(size_t)(end-data))
+         return false;
+      memcpy(packed, data, bytes);
+      memset(packed+bytes, 0, 8);
+      data += bytes;
+      
+      // unpack, with a fixed number of bits per value, from unaligned 64 bit little endian words
+      uint64_t mask = width<32 ? ((uint64_t)1<<width)-1 : 0xFFFFFFFF;
+      for (int i=0; i<n; i++)
+      {
+         size_t bit = (size_t)i*width;
+         uint64_t word;
+         memcpy(&word, packed+bit/8, sizeof(word));
+         block[i] = (word>>(bit%8)) & mask;
+      }
+      // undo zigzag and shift, independently per value so the compiler can vectorize it
+      for (int i=0; i<n; i++)
+         block[i] = (uint32_t)(UnZigZag(block[i])) << shift;
+      // running sum
+      uint32_t value = values[start-1];
+      for (int i=0; i<n; i++)
+      {
+         value += block[i];
+         values[start+i] = value;
+      }
+   }
+   return true;
+}
@@ -0,0 +1,47 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SAMPLECODEC_H
+#define SAMPLECODEC_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Compression of sample series
+ * 
+ * Temperature samples change slowly, so the differences between consecutive samples are small. The encoded
+ * stream stores the first value, followed by the differences in blocks of m_blockSize. Each block is bit-packed
+ * with the width needed by its largest difference (zigzag encoded, so small negative differences stay small).
+ * Differences which are all multiples of a power of 2, like the 11 bit values of the DS1922L in a 16 bit raw
+ * word, are shifted right once for the whole stream.
+ * 
+ * Stream layout: shift (1 byte), first value (zigzag varint), then for every block: bit width (1 byte) and
+ * the packed differences, least significant bit first, padded to full bytes.
+ */
+class SampleCodec
+{
+public:
+   static void Encode(const int32_t* values, int count, std::vector<uint8_t>& output);
+   static bool Decode(const uint8_t* data, size_t size, int32_t* values, int count);
+   
+   static const int m_blockSize = 128;
+};
+
+#endif // SAMPLECODEC_H
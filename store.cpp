@@ -0,0 +1,323 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "store.h"
+#include "ds1922.h"
+#include "ds1922snapshot.h"
+#include <algorithm>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+
+MissionStore::MissionStore()
+{
+   m_indexFd = -1;
+}
+
+MissionStore::~MissionStore()
+{
+   Close();
+}
+
+bool MissionStore::EntryLess(const IndexEntry& a, const IndexEntry& b)
+{
+   if (a.rom!=b.rom)
+      return a.rom<b.rom;
+   return a.firstTime<b.firstTime;
+}
+
+/**
+ * @brief Opens the store in @p directory, creating it if needed
+ */
+bool MissionStore::Open(const char* directory)
+{
+   Close();
+   if (mkdir(directory, 0755)!=0 && errno!=EEXIST) {
+      m_lastError = std::string(directory)+": "+strerror(errno);
+      return false;
+   }
+   m_archiveName = std::string(directory)+"/missions.qiba";
+   std::string indexName = std::string(directory)+"/missions.idx";
+   if (!m_writer.Open(m_archiveName.c_str())) {
+      m_lastError = m_writer.GetLastError();
+      return false;
+   }
+   m_indexFd = open(indexName.c_str(), O_RDWR|O_APPEND|O_CREAT, 0644);
+   if (m_indexFd<0) {
+      m_lastError = indexName+": "+strerror(errno);
+      Close();
+      return false;
+   }
+   if (!Remap()) {
+      Close();
+      return false;
+   }
+   
+   // load the index, and check that its entries match the archive
+   std::vector<IndexEntry> entries;
+   struct stat status;
+   if (fstat(m_indexFd, &status)==0 && status.st_size>=(off_t)sizeof(IndexEntry)) {
+      entries.resize(status.st_size/sizeof(IndexEntry));
+      if (pread(m_indexFd, entries.data(), entries.size()*sizeof(IndexEntry), 0)
+          !=(ssize_t)(entries.size()*sizeof(IndexEntry)))
+         entries.clear();
+   }
+   uint64_t indexed = 0;
+   for (size_t i=0; i<entries.size(); i++)
+   {
+      const MissionHeader* header = m_reader.GetHeaderAt(entries[i].offset);
+      if (!header || header->rom!=entries[i].rom || header->firstSample!=entries[i].firstSample) {
+         entries.clear();
+         indexed = 0;
+         break;
+      }
+      indexed = std::max(indexed, entries[i].offset+header->GetRecordSize());
+   }
+   if (ftruncate(m_indexFd, entries.size()*sizeof(IndexEntry))!=0) {
+      m_lastError = indexName+": "+strerror(errno);
+      Close();
+      return false;
+   }
+   for (size_t i=0; i<entries.size(); i++)
+   {
+      const MissionHeader* header = m_reader.GetHeaderAt(entries[i].offset);
+      AddEntry(*header, entries[i].offset, false);
+   }
+   // index the records appended after the last index update
+   while (indexed<m_reader.GetSize()) {
+      const MissionHeader* header = m_reader.GetHeaderAt(indexed);
+      if (!header)
+         break;
+      if (!AddEntry(*header, indexed, true)) {
+         Close();
+         return false;
+      }
+      indexed += header->GetRecordSize();
+   }
+   return true;
+}
+
+void MissionStore::Close()
+{
+   m_writer.Close();
+   m_reader.Close();
+   if (m_indexFd>=0) {
+      close(m_indexFd);
+      m_indexFd = -1;
+   }
+   m_index.clear();
+   m_mergers.clear();
+}
+
+/**
+ * @brief Maps the current content of the archive file
+ */
+bool MissionStore::Remap()
+{
+   if (!m_reader.Open(m_archiveName.c_str(), false)) {
+      m_lastError = m_reader.GetLastError();
+      return false;
+   }
+   return true;
+}
+
+/**
+ * @brief Adds the record of @p header at @p offset to the in-memory index, and to the index file if @p write is true
+ */
+bool MissionStore::AddEntry(const MissionHeader& header, uint64_t offset, bool write)
+{
+   if (header.sampleCount==0)
+      return true;
+   IndexEntry entry;
+   memset(&entry, 0, sizeof(entry));
+   entry.rom = header.rom;
+   entry.missionStart = header.missionStart;
+   entry.firstTime = header.missionStart + (int64_t)header.firstSample*header.interval;
+   entry.lastTime = entry.firstTime + (int64_t)(header.sampleCount-1)*header.interval;
+   entry.offset = offset;
+   entry.firstSample = header.firstSample;
+   entry.sampleCount = header.sampleCount;
+   if (write && ::write(m_indexFd, &entry, sizeof(entry))!=sizeof(entry)) {
+      m_lastError = std::string("Index: ")+strerror(errno);
+      return false;
+   }
+   m_index.insert(std::upper_bound(m_index.begin(), m_index.end(), entry, EntryLess), entry);
+   // records are added in the order they were appended
+   MissionMerger::Snapshot snapshot;
+   snapshot.missionStart = header.missionStart;
+   snapshot.interval = header.interval;
+   snapshot.firstSample = header.firstSample;
+   snapshot.endSample = header.firstSample + header.sampleCount;
+   MissionMerger& merger = m_mergers[header.rom];
+   merger.Commit(merger.Plan(snapshot));
+   return true;
+}
+
+/**
+ * @brief Downloads the samples of the mission of @p ds1922 not in the store yet, and stores them
+ * 
+ * ReadRegister() has to be called on @p ds1922 before, and it has to be addressed by its ROM ID.
+ * @param int* stored: if not NULL, receives the number of new samples
+ * @param int* lost: if not NULL, receives the number of samples overwritten in the device since the last readout
+ */
+bool MissionStore::Ingest(DS1922& ds1922, int* stored, int* lost)
+{
+   if (stored)
+      *stored = 0;
+   if (lost)
+      *lost = 0;
+   if (m_indexFd<0) {
+      m_lastError = "Store not open";
+      return false;
+   }
+   if (ds1922.GetRom()==0) {
+      m_lastError = "ROM ID of logger unknown";
+      return false;
+   }
+   MissionMerger::Step step = m_mergers[ds1922.GetRom()].Plan(MissionMerger::TakeSnapshot(ds1922));
+   if (lost)
+      *lost = step.lost.count;
+   if (step.count==0)
+      return true;
+   
+   MissionHeader header;
+   uint64_t offset;
+   if (!m_writer.Append(ds1922, step.first, &header, &offset)) {
+      m_lastError = m_writer.GetLastError();
+      return false;
+   }
+   if (!AddEntry(header, offset, true))
+      return false;
+   if (stored)
+      *stored = header.sampleCount;
+   return true;
+}
+
+/**
+ * @brief Stores the new samples held by @p snapshot, like Ingest(DS1922&, ...) without reading the device
+ * 
+ * The snapshot has to be taken with its log.
+ */
+bool MissionStore::Ingest(const DS1922Snapshot& snapshot, int* stored, int* lost)
+{
+   if (stored)
+      *stored = 0;
+   if (lost)
+      *lost = 0;
+   if (m_indexFd<0) {
+      m_lastError = "Store not open";
+      return false;
+   }
+   if (snapshot.GetRom()==0) {
+      m_lastError = "ROM ID of logger unknown";
+      return false;
+   }
+   MissionMerger::Step step = m_mergers[snapshot.GetRom()].Plan(MissionMerger::TakeSnapshot(snapshot));
+   if (lost)
+      *lost = step.lost.count;
+   if (step.count==0)
+      return true;
+   
+   MissionHeader header;
+   uint64_t offset;
+   if (!m_writer.Append(snapshot, step.first, &header, &offset)) {
+      m_lastError = m_writer.GetLastError();
+      return false;
+   }
+   if (!AddEntry(header, offset, true))
+      return false;
+   if (stored)
+      *stored = header.sampleCount;
+   return true;
+}
+
+/**
+ * @brief Returns the samples of logger @p rom from time @p from up to time @p to, inclusive
+ * 
+ * Each record overlapping the range yields one segment, in time order.
+ */
+bool MissionStore::Query(uint64_t rom, time_t from, time_t to, std::vector<Segment>& segments)
+{
+   segments.clear();
+   IndexEntry key;
+   memset(&key, 0, sizeof(key));
+   key.rom = rom;
+   key.firstTime = INT64_MIN;
+   std::vector<IndexEntry>::iterator begin = std::upper_bound(m_index.begin(), m_index.end(), key, EntryLess);
+   key.firstTime = INT64_MAX;
+   std::vector<IndexEntry>::iterator end = std::upper_bound(begin, m_index.end(), key, EntryLess);
+   // records of a logger do not overlap, so lastTime is sorted as well
+   std::vector<IndexEntry>::iterator it = std::partition_point(begin, end,
+      [from](const IndexEntry& entry) {return entry.lastTime<from;});
+   
+   std::vector<int32_t> raw;
+   for (; it!=end && it->firstTime<=to; ++it)
+   {
+      const MissionHeader* header = m_reader.GetHeaderAt(it->offset);
+      if (!header) {
+         if (!Remap() || !(header=m_reader.GetHeaderAt(it->offset))) {
+            m_lastError = m_reader.GetLastError();
+            return false;
+         }
+      }
+      int interval = header->interval>0 ? header->interval : 1;
+      int first = from>it->firstTime ? (from-it->firstTime+interval-1)/interval : 0;
+      int last = to<it->lastTime ? (to-it->firstTime)/interval+1 : it->sampleCount;
+      if (first>=last)
+         continue;
+      // the samples behind the range are not decoded
+      raw.resize(last);
+      if (!m_reader.GetRawValues(header, raw.data(), last)) {
+         m_lastError = m_reader.GetLastError();
+         return false;
+      }
+      Segment segment;
+      segment.start = it->firstTime + (time_t)first*interval;
+      segment.interval = interval;
+      segment.values.resize(last-first);
+      header->ConvertValues(raw.data()+first, last-first, segment.values.data());
+      segments.push_back(segment);
+   }
+   return true;
+}
+
+/**
+ * @brief Returns the state of the current mission of logger @p rom, or NULL if it is not in the store
+ */
+const MissionMerger* MissionStore::GetMerger(uint64_t rom)
+{
+   std::map<uint64_t, MissionMerger>::iterator it = m_mergers.find(rom);
+   return it!=m_mergers.end() ? &it->second : NULL;
+}
+
+/**
+ * @brief Returns the ROM IDs of all loggers in the store
+ */
+std::vector<uint64_t> MissionStore::GetRoms()
+{
+   std::vector<uint64_t> roms;
+   for (size_t i=0; i<m_index.size(); i++)
+   {
+      if (roms.empty() || roms.back()!=m_index[i].rom)
+         roms.push_back(m_index[i].rom);
+   }
+   return roms;
+}
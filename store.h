@@ -0,0 +1,98 @@
+/*
+    QIButton: read DS1922 IButton via DS9490B USB 1-Wire
+    Copyright (C) 2014  Karsten Koop <karsten.koop@gmx.de>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <cstdint>
+
+#include "archive.h"
+#include "missionmerger.h"
+
+class DS1922;
+class DS1922Snapshot;
+
+/**
+ * @brief Append-only store of the samples of all loggers, indexed by ROM ID and time
+ * 
+ * The store is a directory with an archive file, see ArchiveWriter, holding one record per ingested readout,
+ * and an index file with one IndexEntry per record. Ingest() only downloads and stores the samples of a mission
+ * which are not in the store yet, so records of the same mission never overlap. The records of each logger are
+ * stitched by a MissionMerger, which also keeps the gaps of its current mission. The index is kept in memory
+ * sorted by ROM ID and time, so Query() only decodes the records overlapping the requested range.
+ * The archive is authoritative: records missing from the index, e.g. after a crash between the two writes,
+ * are indexed again by Open().
+ * 
+ * Functions return false on error, and the error message can be retrieved using GetLastError().
+ */
+class MissionStore
+{
+public:
+   MissionStore();
+   ~MissionStore();
+   
+public:
+   /** @brief Consecutive samples of a query result */
+   struct Segment
+   {
+      time_t start;     // time of values[0]
+      int interval;     // seconds between samples
+      std::vector<double> values;
+   };
+   
+   std::string GetLastError() {return m_lastError;}
+   bool Open(const char* directory);
+   void Close();
+   bool Ingest(DS1922& ds1922, int* stored=NULL, int* lost=NULL);
+   bool Ingest(const DS1922Snapshot& snapshot, int* stored=NULL, int* lost=NULL);
+   bool Query(uint64_t rom, time_t from, time_t to, std::vector<Segment>& segments);
+   std::vector<uint64_t> GetRoms();
+   const MissionMerger* GetMerger(uint64_t rom);
+   
+protected:
+   /** @brief Index file entry, describing one archive record */
+   struct IndexEntry
+   {
+      uint64_t rom;
+      int64_t missionStart;
+      int64_t firstTime;      // time of the first stored sample
+      int64_t lastTime;       // time of the last stored sample
+      uint64_t offset;        // of the record in the archive file
+      uint32_t firstSample;   // mission sample number of the first stored sample
+      uint32_t sampleCount;
+   };
+   static bool EntryLess(const IndexEntry& a, const IndexEntry& b);
+   bool AddEntry(const MissionHeader& header, uint64_t offset, bool write);
+   bool Remap();
+   
+   // Data
+private:
+   std::string m_lastError;
+   std::string m_archiveName;
+   int m_indexFd;
+   ArchiveWriter m_writer;
+   ArchiveReader m_reader;
+   std::vector<IndexEntry> m_index;              // sorted by EntryLess
+   std::map<uint64_t, MissionMerger> m_mergers;  // current mission per ROM ID
+};
+
+#endif // STORE_H